@@ -0,0 +1,111 @@
+#ifndef BALLOON_HPP
+#define BALLOON_HPP
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "helper.hpp"
+#include "report.hpp"
+
+namespace tps {
+
+// MemAvailable of /proc/meminfo, free memory plus what the kernel can
+// reclaim, i.e. the most the page cache can grow to
+static size_t get_available_memory() {
+  std::ifstream fs("/proc/meminfo");
+  std::string key;
+  size_t value;
+  while (fs >> key >> value) {
+    if (key.compare("MemAvailable:") == 0) return value * 1024;
+    fs.ignore(256, '\n');
+  }
+  return get_total_memory();
+}
+
+// Anonymous memory held for the length of a run so that only about limit
+// bytes stay available to the page cache. Chunks are mlock'ed, or touched
+// when RLIMIT_MEMLOCK does not allow it, and are not inherited by forked
+// workers.
+class MemoryBalloon {
+ public:
+  static constexpr size_t CHUNK_SIZE = 64 * 1024 * 1024;
+
+  MemoryBalloon() : bytes_(0), locked_(true), budget_(0) {}
+  ~MemoryBalloon() { deflate(); }
+
+  MemoryBalloon(const MemoryBalloon &) = delete;
+  MemoryBalloon &operator=(const MemoryBalloon &) = delete;
+
+  // Grow until MemAvailable is down to limit. It is read again after every
+  // chunk, since inflating evicts page cache and that is available too.
+  void inflate(size_t limit) {
+    deflate();
+    bytes_ = 0;
+    locked_ = true;
+    size_t page_size = get_page_size();
+    while (true) {
+      size_t avail = get_available_memory();
+      if (avail <= limit + page_size || bytes_ >= get_total_memory()) break;
+      size_t len =
+          std::min(CHUNK_SIZE, (avail - limit) / page_size * page_size);
+      void *ptr = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (ptr == MAP_FAILED) break;
+      madvise(ptr, len, MADV_DONTFORK);
+      madvise(ptr, len, MADV_NOHUGEPAGE);
+      if (mlock(ptr, len) != 0) {
+        locked_ = false;
+        memset(ptr, 1, len);
+      }
+      chunks_.push_back({static_cast<char *>(ptr), len});
+      bytes_ += len;
+    }
+    budget_ = get_available_memory();
+  }
+
+  void deflate() {
+    for (const Chunk &c : chunks_) munmap(c.ptr, c.len);
+    chunks_.clear();
+  }
+
+  // Bytes held by the last inflate(), whether all of them were locked and
+  // MemAvailable right after it
+  size_t bytes() const { return bytes_; }
+  bool locked() const { return locked_; }
+  size_t budget() const { return budget_; }
+
+ private:
+  struct Chunk {
+    char *ptr;
+    size_t len;
+  };
+
+  std::vector<Chunk> chunks_;
+  size_t bytes_;
+  bool locked_;
+  size_t budget_;
+};
+
+static void print_balloon(std::ostream &os, size_t bytes, bool locked,
+                          size_t budget) {
+  os << "memory balloon: " << bytes << " bytes "
+     << (locked ? "locked" : "touched") << ", cache budget: " << budget
+     << " bytes" << std::endl;
+}
+
+static void add_balloon(Report *report, size_t bytes, bool locked,
+                        size_t budget) {
+  report->add_result("balloon_bytes", bytes);
+  report->add_result("balloon_locked", locked ? 1 : 0);
+  report->add_result("cache_budget_bytes", budget);
+}
+
+}  // namespace tps
+
+#endif  // BALLOON_HPP
@@ -0,0 +1,176 @@
+#ifndef BUFFER_HPP
+#define BUFFER_HPP
+
+#include <errno.h>
+#include <sys/mman.h>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "helper.hpp"
+#include "io_exception.hpp"
+
+namespace tps {
+
+// Backing of I/O buffers. THP asks the kernel to back the buffer with
+// transparent huge pages, HUGETLB takes pages from the hugetlbfs pool.
+enum class HugePages { OFF, THP, HUGETLB };
+
+static bool parse_huge_pages(const std::string &str, HugePages *mode) {
+  std::string value = to_lower(str);
+  if (value.compare("off") == 0)
+    *mode = HugePages::OFF;
+  else if (value.compare("thp") == 0)
+    *mode = HugePages::THP;
+  else if (value.compare("hugetlb") == 0)
+    *mode = HugePages::HUGETLB;
+  else
+    return false;
+  return true;
+}
+
+static std::string huge_pages_name(HugePages mode) {
+  switch (mode) {
+    case HugePages::THP:
+      return "thp";
+    case HugePages::HUGETLB:
+      return "hugetlb";
+    default:
+      return "off";
+  }
+}
+
+static size_t get_huge_page_size() {
+  std::ifstream fs("/proc/meminfo");
+  std::string key;
+  size_t value;
+  while (fs >> key >> value) {
+    if (key.compare("Hugepagesize:") == 0) return value * 1024;
+    fs.ignore(256, '\n');
+  }
+  return 2 * 1024 * 1024;
+}
+
+// Bytes actually mapped for a buffer of size bytes
+static size_t buffer_map_size(size_t size, HugePages mode) {
+  size_t unit = mode == HugePages::OFF ? get_page_size() : get_huge_page_size();
+  return (std::max<size_t>(size, 1) + unit - 1) / unit * unit;
+}
+
+// Map a buffer aligned to align, at least a page, and touch every page of
+// it, so that neither page faults nor huge page compaction land in the
+// timed loops.
+static char *map_buffer(size_t size, HugePages mode, size_t align) {
+  size_t map_size = buffer_map_size(size, mode);
+  size_t unit = mode == HugePages::OFF ? get_page_size() : get_huge_page_size();
+  size_t extra = align > unit ? align : 0;
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+  if (mode == HugePages::HUGETLB) flags |= MAP_HUGETLB;
+  void *ptr =
+      mmap(nullptr, map_size + extra, PROT_READ | PROT_WRITE, flags, -1, 0);
+  if (ptr == MAP_FAILED) {
+    if (mode == HugePages::HUGETLB)
+      throw IOException("Failed to map " + std::to_string(map_size) +
+                        " bytes of huge pages, error " +
+                        std::to_string(errno) +
+                        ", check /proc/sys/vm/nr_hugepages");
+    throw IOException("Failed to map " + std::to_string(map_size) +
+                      " bytes, error " + std::to_string(errno));
+  }
+  if (extra > 0) {
+    // Trim the mapping to an aligned start, the unit divides both ends
+    char *base = static_cast<char *>(ptr);
+    uintptr_t addr = reinterpret_cast<uintptr_t>(base);
+    size_t head = (align - addr % align) % align;
+    if (head > 0) munmap(base, head);
+    if (extra - head > 0) munmap(base + head + map_size, extra - head);
+    ptr = base + head;
+  }
+  if (mode == HugePages::THP)
+    madvise(ptr, map_size, MADV_HUGEPAGE);
+  else if (mode == HugePages::OFF)
+    madvise(ptr, map_size, MADV_NOHUGEPAGE);
+  memset(ptr, 0, map_size);
+  return static_cast<char *>(ptr);
+}
+
+// Buffers freed by threads stay mapped and touched here, so that the next
+// thread asking for the same size, e.g. in the next point of a sweep, takes
+// one without a new mapping or page faults. Past MAX_FREE bytes freed
+// buffers are unmapped.
+class BufferPool {
+ public:
+  static constexpr size_t MAX_FREE = 1ULL << 30;
+
+  static BufferPool &instance() {
+    static BufferPool pool;
+    return pool;
+  }
+
+  ~BufferPool() {
+    for (const Entry &e : free_) munmap(e.buf, e.map_size);
+  }
+
+  char *acquire(size_t size, HugePages mode, size_t align) {
+    size_t map_size = buffer_map_size(size, mode);
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      for (size_t i = 0; i < free_.size(); i++) {
+        const Entry &e = free_[i];
+        if (e.map_size != map_size || e.mode != mode ||
+            (align > 0 && reinterpret_cast<uintptr_t>(e.buf) % align != 0))
+          continue;
+        char *buf = e.buf;
+        free_bytes_ -= e.map_size;
+        free_[i] = free_.back();
+        free_.pop_back();
+        return buf;
+      }
+    }
+    return map_buffer(size, mode, align);
+  }
+
+  void release(char *buf, size_t size, HugePages mode) {
+    size_t map_size = buffer_map_size(size, mode);
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      if (free_bytes_ + map_size <= MAX_FREE) {
+        free_.push_back({buf, map_size, mode});
+        free_bytes_ += map_size;
+        return;
+      }
+    }
+    munmap(buf, map_size);
+  }
+
+ private:
+  struct Entry {
+    char *buf;
+    size_t map_size;
+    HugePages mode;
+  };
+
+  BufferPool() : free_bytes_(0) {}
+
+  std::mutex mtx_;
+  std::vector<Entry> free_;
+  size_t free_bytes_;
+};
+
+// Buffer of at least size bytes aligned to align, 0 for a page, taken from
+// the pool when one was freed before
+static char *alloc_buffer(size_t size, HugePages mode, size_t align = 0) {
+  return BufferPool::instance().acquire(size, mode, align);
+}
+
+static void free_buffer(char *buf, size_t size, HugePages mode) {
+  if (buf != nullptr) BufferPool::instance().release(buf, size, mode);
+}
+
+}  // namespace tps
+
+#endif  // BUFFER_HPP
@@ -4,9 +4,22 @@ g++ -std=c++11 -W -Wno-unused-result -Wmaybe-uninitialized -O3 \
     -o file_write 
 
 g++ -std=c++11 -W -Wno-unused-result -Wmaybe-uninitialized -pthread -O3 \
-    main_lookup.cpp file_lookup.cpp \
+    main_lookup.cpp file_lookup.cpp uring.cpp \
     -o file_lookup 
 
 g++ -std=c++11 -W -Wno-unused-result -Wmaybe-uninitialized -pthread -O3 \
-    main_scan.cpp file_scan.cpp \
+    main_scan.cpp file_scan.cpp compute.cpp uring.cpp \
     -o file_scan 
+
+g++ -std=c++11 -W -Wno-unused-result -Wmaybe-uninitialized -O3 \
+    main_harness.cpp \
+    -o harness_bench 
+
+g++ -std=c++11 -W -Wno-unused-result -Wmaybe-uninitialized -pthread -O3 \
+    main_bench.cpp file_write.cpp file_lookup.cpp file_scan.cpp file_replay.cpp \
+    compute.cpp uring.cpp \
+    -o tps_bench 
+
+g++ -std=c++11 -W -Wno-unused-result -Wmaybe-uninitialized -pthread -O3 \
+    main_replay.cpp file_replay.cpp uring.cpp \
+    -o file_replay 
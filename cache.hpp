@@ -0,0 +1,122 @@
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "helper.hpp"
+#include "io_exception.hpp"
+#include "report.hpp"
+
+namespace tps {
+
+// Page cache state of the files before a run. COLD evicts them with
+// posix_fadvise(DONTNEED), which needs no root but cannot drop dirty or
+// mapped pages, WARM reads them once and AS_IS leaves the cache alone.
+enum class CacheMode { AS_IS, COLD, WARM };
+
+static bool parse_cache_mode(const std::string &str, CacheMode *mode) {
+  std::string value = to_lower(str);
+  if (value.compare("as-is") == 0)
+    *mode = CacheMode::AS_IS;
+  else if (value.compare("cold") == 0)
+    *mode = CacheMode::COLD;
+  else if (value.compare("warm") == 0)
+    *mode = CacheMode::WARM;
+  else
+    return false;
+  return true;
+}
+
+static std::string cache_mode_name(CacheMode mode) {
+  switch (mode) {
+    case CacheMode::COLD:
+      return "cold";
+    case CacheMode::WARM:
+      return "warm";
+    default:
+      return "as-is";
+  }
+}
+
+// files[i] is opened relative to dir_fds[file_dirs[i]]
+static void prepare_cache(const std::vector<int> &dir_fds,
+                          const std::vector<uint32_t> &file_dirs,
+                          const std::vector<std::string> &files,
+                          CacheMode mode) {
+  if (mode == CacheMode::AS_IS) return;
+  std::vector<char> buf(mode == CacheMode::WARM ? 1 << 20 : 0);
+  for (size_t i = 0; i < files.size(); i++) {
+    const std::string &f = files[i];
+    int fd = openat(dir_fds[file_dirs[i]], f.c_str(), O_RDONLY);
+    if (fd == -1)
+      throw IOException("Failed to open " + f + ", error " +
+                        std::to_string(errno));
+    if (mode == CacheMode::COLD) {
+      fdatasync(fd);
+      posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    } else {
+      posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+      ssize_t n;
+      while ((n = ::read(fd, buf.data(), buf.size())) > 0) {
+      }
+      if (n == -1) {
+        int err = errno;
+        close(fd);
+        throw IOException("Failed to read " + f + ", error " +
+                          std::to_string(err));
+      }
+    }
+    close(fd);
+  }
+}
+
+// Fraction of the bytes of the files that are in the page cache, from
+// mincore() over a read-only mapping of each file
+static double cache_residency(const std::vector<int> &dir_fds,
+                              const std::vector<uint32_t> &file_dirs,
+                              const std::vector<std::string> &files,
+                              const std::vector<size_t> &sizes) {
+  size_t page_size = get_page_size();
+  size_t total_pages = 0;
+  size_t resident_pages = 0;
+  std::vector<unsigned char> vec;
+  for (size_t i = 0; i < files.size(); i++) {
+    if (sizes[i] == 0 || sizes[i] == (size_t)-1) continue;
+    size_t pages = (sizes[i] + page_size - 1) / page_size;
+    total_pages += pages;
+    int fd = openat(dir_fds[file_dirs[i]], files[i].c_str(), O_RDONLY);
+    if (fd == -1) continue;
+    void *ptr = mmap(nullptr, sizes[i], PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) continue;
+    vec.resize(pages);
+    if (mincore(ptr, sizes[i], vec.data()) == 0) {
+      for (unsigned char v : vec) resident_pages += v & 1;
+    }
+    munmap(ptr, sizes[i]);
+  }
+  return total_pages == 0 ? 0.0 : 1.0 * resident_pages / total_pages;
+}
+
+static void print_cache_residency(std::ostream &os, double before,
+                                  double after) {
+  os << "page cache resident: " << 100.0 * before << "% before, "
+     << 100.0 * after << "% after" << std::endl;
+}
+
+static void add_cache_residency(Report *report, double before, double after) {
+  report->add_ratio("cache_resident_before", before);
+  report->add_ratio("cache_resident_after", after);
+}
+
+}  // namespace tps
+
+#endif  // CACHE_HPP
@@ -0,0 +1,503 @@
+#include "compute.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TPS_X86 1
+#endif
+
+#include "helper.hpp"
+
+namespace tps {
+
+static const uint32_t HASH_MUL = 0x9E3779B1u;
+
+static inline uint32_t mix32(uint32_t w) { return (w ^ (w >> 15)) * HASH_MUL; }
+
+template <typename T>
+static inline T load_value(const char *p) {
+  T v;
+  memcpy(&v, p, sizeof(T));
+  return v;
+}
+
+// All kernels take the number of complete columns in buf. The hash kernel
+// always works on 32-bit words so that every ISA produces the same value.
+struct ComputeKernels {
+  template <typename T>
+  static void scalar_sum(const char *buf, size_t n, uint64_t, Compute *st) {
+    uint64_t s = 0;
+    for (size_t i = 0; i < n; i++) s += load_value<T>(buf + i * sizeof(T));
+    st->sum_ += s;
+  }
+
+  template <typename T>
+  static void scalar_minmax(const char *buf, size_t n, uint64_t, Compute *st) {
+    T lo = std::numeric_limits<T>::max();
+    T hi = std::numeric_limits<T>::min();
+    for (size_t i = 0; i < n; i++) {
+      T v = load_value<T>(buf + i * sizeof(T));
+      lo = std::min(lo, v);
+      hi = std::max(hi, v);
+    }
+    if (n > 0) {
+      st->min_ = std::min<uint64_t>(st->min_, lo);
+      st->max_ = std::max<uint64_t>(st->max_, hi);
+    }
+  }
+
+  template <typename T>
+  static void scalar_count(const char *buf, size_t n, uint64_t threshold,
+                           Compute *st) {
+    T t = static_cast<T>(threshold);
+    uint64_t c = 0;
+    for (size_t i = 0; i < n; i++) c += load_value<T>(buf + i * sizeof(T)) <= t;
+    st->count_ += c;
+  }
+
+  template <typename T>
+  static void scalar_hash(const char *buf, size_t n, uint64_t, Compute *st) {
+    size_t words = n * sizeof(T) / sizeof(uint32_t);
+    uint32_t h = 0;
+    for (size_t i = 0; i < words; i++)
+      h += mix32(load_value<uint32_t>(buf + i * sizeof(uint32_t)));
+    st->hash_ = static_cast<uint32_t>(st->hash_ + h);
+  }
+
+#ifdef TPS_X86
+  __attribute__((target("avx2"))) static uint64_t avx2_hsum64(__m256i v) {
+    alignas(32) uint64_t lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), v);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  }
+
+  __attribute__((target("avx2"))) static void avx2_sum32(const char *buf,
+                                                         size_t n, uint64_t,
+                                                         Compute *st) {
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m256i v =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(buf + i * 4));
+      acc = _mm256_add_epi64(
+          acc, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(v)));
+      acc = _mm256_add_epi64(
+          acc, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(v, 1)));
+    }
+    st->sum_ += avx2_hsum64(acc);
+    scalar_sum<uint32_t>(buf + i * 4, n - i, 0, st);
+  }
+
+  __attribute__((target("avx2"))) static void avx2_sum64(const char *buf,
+                                                         size_t n, uint64_t,
+                                                         Compute *st) {
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+      acc = _mm256_add_epi64(acc, _mm256_loadu_si256(
+                                      reinterpret_cast<const __m256i *>(
+                                          buf + i * 8)));
+    st->sum_ += avx2_hsum64(acc);
+    scalar_sum<uint64_t>(buf + i * 8, n - i, 0, st);
+  }
+
+  __attribute__((target("avx2"))) static void avx2_minmax32(const char *buf,
+                                                            size_t n, uint64_t,
+                                                            Compute *st) {
+    __m256i lo = _mm256_set1_epi32(-1);
+    __m256i hi = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m256i v =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(buf + i * 4));
+      lo = _mm256_min_epu32(lo, v);
+      hi = _mm256_max_epu32(hi, v);
+    }
+    if (i > 0) {
+      alignas(32) uint32_t l[8];
+      alignas(32) uint32_t h[8];
+      _mm256_store_si256(reinterpret_cast<__m256i *>(l), lo);
+      _mm256_store_si256(reinterpret_cast<__m256i *>(h), hi);
+      st->min_ = std::min<uint64_t>(st->min_, *std::min_element(l, l + 8));
+      st->max_ = std::max<uint64_t>(st->max_, *std::max_element(h, h + 8));
+    }
+    scalar_minmax<uint32_t>(buf + i * 4, n - i, 0, st);
+  }
+
+  __attribute__((target("avx2"))) static void avx2_minmax64(const char *buf,
+                                                            size_t n, uint64_t,
+                                                            Compute *st) {
+    // AVX2 has no unsigned 64-bit compare, so flip the sign bit and compare
+    // as signed.
+    const __m256i bias =
+        _mm256_set1_epi64x(std::numeric_limits<int64_t>::min());
+    __m256i lo = _mm256_set1_epi64x(-1);
+    __m256i hi = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      __m256i v =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(buf + i * 8));
+      __m256i vb = _mm256_xor_si256(v, bias);
+      __m256i lt = _mm256_cmpgt_epi64(_mm256_xor_si256(lo, bias), vb);
+      __m256i gt = _mm256_cmpgt_epi64(vb, _mm256_xor_si256(hi, bias));
+      lo = _mm256_blendv_epi8(lo, v, lt);
+      hi = _mm256_blendv_epi8(hi, v, gt);
+    }
+    if (i > 0) {
+      alignas(32) uint64_t l[4];
+      alignas(32) uint64_t h[4];
+      _mm256_store_si256(reinterpret_cast<__m256i *>(l), lo);
+      _mm256_store_si256(reinterpret_cast<__m256i *>(h), hi);
+      st->min_ = std::min(st->min_, *std::min_element(l, l + 4));
+      st->max_ = std::max(st->max_, *std::max_element(h, h + 4));
+    }
+    scalar_minmax<uint64_t>(buf + i * 8, n - i, 0, st);
+  }
+
+  __attribute__((target("avx2"))) static void avx2_count32(const char *buf,
+                                                           size_t n,
+                                                           uint64_t threshold,
+                                                           Compute *st) {
+    const __m256i bias = _mm256_set1_epi32(std::numeric_limits<int32_t>::min());
+    const __m256i t = _mm256_xor_si256(
+        _mm256_set1_epi32(static_cast<int32_t>(threshold)), bias);
+    __m256i gts = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m256i v =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(buf + i * 4));
+      // Matching lanes are -1, so subtracting counts values above threshold
+      gts = _mm256_sub_epi32(
+          gts, _mm256_cmpgt_epi32(_mm256_xor_si256(v, bias), t));
+    }
+    alignas(32) uint32_t lanes[8];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), gts);
+    uint64_t above = 0;
+    for (int k = 0; k < 8; k++) above += lanes[k];
+    st->count_ += i - above;
+    scalar_count<uint32_t>(buf + i * 4, n - i, threshold, st);
+  }
+
+  __attribute__((target("avx2"))) static void avx2_count64(const char *buf,
+                                                           size_t n,
+                                                           uint64_t threshold,
+                                                           Compute *st) {
+    const __m256i bias =
+        _mm256_set1_epi64x(std::numeric_limits<int64_t>::min());
+    const __m256i t = _mm256_xor_si256(
+        _mm256_set1_epi64x(static_cast<int64_t>(threshold)), bias);
+    __m256i gts = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      __m256i v =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(buf + i * 8));
+      gts = _mm256_sub_epi64(
+          gts, _mm256_cmpgt_epi64(_mm256_xor_si256(v, bias), t));
+    }
+    st->count_ += i - avx2_hsum64(gts);
+    scalar_count<uint64_t>(buf + i * 8, n - i, threshold, st);
+  }
+
+  template <typename T>
+  __attribute__((target("avx2"))) static void avx2_hash(const char *buf,
+                                                        size_t n, uint64_t,
+                                                        Compute *st) {
+    size_t words = n * sizeof(T) / sizeof(uint32_t);
+    const __m256i mul = _mm256_set1_epi32(static_cast<int32_t>(HASH_MUL));
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= words; i += 8) {
+      __m256i v =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(buf + i * 4));
+      v = _mm256_xor_si256(v, _mm256_srli_epi32(v, 15));
+      acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(v, mul));
+    }
+    alignas(32) uint32_t lanes[8];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), acc);
+    uint32_t h = 0;
+    for (int k = 0; k < 8; k++) h += lanes[k];
+    for (; i < words; i++) h += mix32(load_value<uint32_t>(buf + i * 4));
+    st->hash_ = static_cast<uint32_t>(st->hash_ + h);
+  }
+
+  __attribute__((target("avx512f"))) static void avx512_sum32(const char *buf,
+                                                             size_t n,
+                                                             uint64_t,
+                                                             Compute *st) {
+    __m512i acc = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+      __m512i v = _mm512_loadu_si512(buf + i * 4);
+      acc = _mm512_add_epi64(acc,
+                             _mm512_cvtepu32_epi64(_mm512_castsi512_si256(v)));
+      acc = _mm512_add_epi64(
+          acc, _mm512_cvtepu32_epi64(_mm512_extracti64x4_epi64(v, 1)));
+    }
+    st->sum_ += static_cast<uint64_t>(_mm512_reduce_add_epi64(acc));
+    scalar_sum<uint32_t>(buf + i * 4, n - i, 0, st);
+  }
+
+  __attribute__((target("avx512f"))) static void avx512_sum64(const char *buf,
+                                                             size_t n,
+                                                             uint64_t,
+                                                             Compute *st) {
+    __m512i acc = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+      acc = _mm512_add_epi64(acc, _mm512_loadu_si512(buf + i * 8));
+    st->sum_ += static_cast<uint64_t>(_mm512_reduce_add_epi64(acc));
+    scalar_sum<uint64_t>(buf + i * 8, n - i, 0, st);
+  }
+
+  __attribute__((target("avx512f"))) static void avx512_minmax32(
+      const char *buf, size_t n, uint64_t, Compute *st) {
+    __m512i lo = _mm512_set1_epi32(-1);
+    __m512i hi = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+      __m512i v = _mm512_loadu_si512(buf + i * 4);
+      lo = _mm512_min_epu32(lo, v);
+      hi = _mm512_max_epu32(hi, v);
+    }
+    if (i > 0) {
+      st->min_ = std::min<uint64_t>(st->min_, _mm512_reduce_min_epu32(lo));
+      st->max_ = std::max<uint64_t>(st->max_, _mm512_reduce_max_epu32(hi));
+    }
+    scalar_minmax<uint32_t>(buf + i * 4, n - i, 0, st);
+  }
+
+  __attribute__((target("avx512f"))) static void avx512_minmax64(
+      const char *buf, size_t n, uint64_t, Compute *st) {
+    __m512i lo = _mm512_set1_epi64(-1);
+    __m512i hi = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m512i v = _mm512_loadu_si512(buf + i * 8);
+      lo = _mm512_min_epu64(lo, v);
+      hi = _mm512_max_epu64(hi, v);
+    }
+    if (i > 0) {
+      st->min_ = std::min<uint64_t>(st->min_, _mm512_reduce_min_epu64(lo));
+      st->max_ = std::max<uint64_t>(st->max_, _mm512_reduce_max_epu64(hi));
+    }
+    scalar_minmax<uint64_t>(buf + i * 8, n - i, 0, st);
+  }
+
+  __attribute__((target("avx512f"))) static void avx512_count32(
+      const char *buf, size_t n, uint64_t threshold, Compute *st) {
+    const __m512i t = _mm512_set1_epi32(static_cast<int32_t>(threshold));
+    uint64_t c = 0;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+      c += __builtin_popcount(
+          _mm512_cmple_epu32_mask(_mm512_loadu_si512(buf + i * 4), t));
+    st->count_ += c;
+    scalar_count<uint32_t>(buf + i * 4, n - i, threshold, st);
+  }
+
+  __attribute__((target("avx512f"))) static void avx512_count64(
+      const char *buf, size_t n, uint64_t threshold, Compute *st) {
+    const __m512i t = _mm512_set1_epi64(static_cast<int64_t>(threshold));
+    uint64_t c = 0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+      c += __builtin_popcount(
+          _mm512_cmple_epu64_mask(_mm512_loadu_si512(buf + i * 8), t));
+    st->count_ += c;
+    scalar_count<uint64_t>(buf + i * 8, n - i, threshold, st);
+  }
+
+  template <typename T>
+  __attribute__((target("avx512f"))) static void avx512_hash(const char *buf,
+                                                            size_t n, uint64_t,
+                                                            Compute *st) {
+    size_t words = n * sizeof(T) / sizeof(uint32_t);
+    const __m512i mul = _mm512_set1_epi32(static_cast<int32_t>(HASH_MUL));
+    __m512i acc = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 16 <= words; i += 16) {
+      __m512i v = _mm512_loadu_si512(buf + i * 4);
+      v = _mm512_xor_si512(v, _mm512_srli_epi32(v, 15));
+      acc = _mm512_add_epi32(acc, _mm512_mullo_epi32(v, mul));
+    }
+    uint32_t h = static_cast<uint32_t>(_mm512_reduce_add_epi32(acc));
+    for (; i < words; i++) h += mix32(load_value<uint32_t>(buf + i * 4));
+    st->hash_ = static_cast<uint32_t>(st->hash_ + h);
+  }
+#endif
+
+  static Compute::KernelFn select(Compute::Kernel kernel, size_t width,
+                                  Compute::Isa isa) {
+    bool w4 = width == 4;
+#ifdef TPS_X86
+    if (isa == Compute::AVX512) {
+      switch (kernel) {
+        case Compute::SUM:
+          return w4 ? avx512_sum32 : avx512_sum64;
+        case Compute::MINMAX:
+          return w4 ? avx512_minmax32 : avx512_minmax64;
+        case Compute::COUNT:
+          return w4 ? avx512_count32 : avx512_count64;
+        case Compute::HASH:
+          return w4 ? avx512_hash<uint32_t> : avx512_hash<uint64_t>;
+        default:
+          return nullptr;
+      }
+    }
+    if (isa == Compute::AVX2) {
+      switch (kernel) {
+        case Compute::SUM:
+          return w4 ? avx2_sum32 : avx2_sum64;
+        case Compute::MINMAX:
+          return w4 ? avx2_minmax32 : avx2_minmax64;
+        case Compute::COUNT:
+          return w4 ? avx2_count32 : avx2_count64;
+        case Compute::HASH:
+          return w4 ? avx2_hash<uint32_t> : avx2_hash<uint64_t>;
+        default:
+          return nullptr;
+      }
+    }
+#endif
+    switch (kernel) {
+      case Compute::SUM:
+        return w4 ? scalar_sum<uint32_t> : scalar_sum<uint64_t>;
+      case Compute::MINMAX:
+        return w4 ? scalar_minmax<uint32_t> : scalar_minmax<uint64_t>;
+      case Compute::COUNT:
+        return w4 ? scalar_count<uint32_t> : scalar_count<uint64_t>;
+      case Compute::HASH:
+        return w4 ? scalar_hash<uint32_t> : scalar_hash<uint64_t>;
+      default:
+        return nullptr;
+    }
+  }
+};
+
+Compute::Compute(Kernel kernel, size_t column_width, double selectivity,
+                 Isa isa)
+    : kernel_(kernel),
+      isa_(isa == AUTO ? detect_isa() : std::min(isa, detect_isa())),
+      width_(column_width == 4 ? 4 : 8),
+      selectivity_(std::max(0.0, std::min(1.0, selectivity))),
+      values_(0),
+      sum_(0),
+      min_(std::numeric_limits<uint64_t>::max()),
+      max_(0),
+      count_(0),
+      hash_(0) {
+  double range = width_ == 4 ? 4294967295.0 : 18446744073709551615.0;
+  threshold_ = selectivity_ >= 1.0
+                   ? std::numeric_limits<uint64_t>::max()
+                   : static_cast<uint64_t>(selectivity_ * range);
+  if (width_ == 4)
+    threshold_ = std::min<uint64_t>(threshold_,
+                                    std::numeric_limits<uint32_t>::max());
+  fn_ = ComputeKernels::select(kernel_, width_, isa_);
+}
+
+void Compute::consume(const char *buf, size_t len) {
+  if (fn_ == nullptr) return;
+  size_t n = len / width_;
+  fn_(buf, n, threshold_, this);
+  values_ += n;
+}
+
+void Compute::merge(const Compute &other) {
+  values_ += other.values_;
+  sum_ += other.sum_;
+  min_ = std::min(min_, other.min_);
+  max_ = std::max(max_, other.max_);
+  count_ += other.count_;
+  hash_ = static_cast<uint32_t>(hash_ + other.hash_);
+}
+
+std::string Compute::result() const {
+  switch (kernel_) {
+    case SUM:
+      return std::to_string(sum_);
+    case MINMAX:
+      return values_ == 0 ? "[]"
+                          : "[" + std::to_string(min_) + ", " +
+                                std::to_string(max_) + "]";
+    case COUNT:
+      return std::to_string(count_) + " / " + std::to_string(values_);
+    case HASH:
+      return std::to_string(hash_);
+    default:
+      return "";
+  }
+}
+
+Compute::Isa Compute::detect_isa() {
+#ifdef TPS_X86
+  if (__builtin_cpu_supports("avx512f")) return AVX512;
+  if (__builtin_cpu_supports("avx2")) return AVX2;
+#endif
+  return SCALAR;
+}
+
+bool Compute::parse_kernel(const std::string &str, Kernel *kernel) {
+  std::string value = to_lower(str);
+  if (value.compare("none") == 0)
+    *kernel = NONE;
+  else if (value.compare("sum") == 0)
+    *kernel = SUM;
+  else if (value.compare("minmax") == 0)
+    *kernel = MINMAX;
+  else if (value.compare("count") == 0)
+    *kernel = COUNT;
+  else if (value.compare("hash") == 0)
+    *kernel = HASH;
+  else
+    return false;
+  return true;
+}
+
+bool Compute::parse_isa(const std::string &str, Isa *isa) {
+  std::string value = to_lower(str);
+  if (value.compare("auto") == 0)
+    *isa = AUTO;
+  else if (value.compare("scalar") == 0)
+    *isa = SCALAR;
+  else if (value.compare("avx2") == 0)
+    *isa = AVX2;
+  else if (value.compare("avx512") == 0)
+    *isa = AVX512;
+  else
+    return false;
+  return true;
+}
+
+std::string Compute::kernel_name(Kernel kernel) {
+  switch (kernel) {
+    case SUM:
+      return "sum";
+    case MINMAX:
+      return "minmax";
+    case COUNT:
+      return "count";
+    case HASH:
+      return "hash";
+    default:
+      return "none";
+  }
+}
+
+std::string Compute::isa_name(Isa isa) {
+  switch (isa) {
+    case SCALAR:
+      return "scalar";
+    case AVX2:
+      return "avx2";
+    case AVX512:
+      return "avx512";
+    default:
+      return "auto";
+  }
+}
+
+}  // namespace tps
@@ -0,0 +1,70 @@
+#ifndef COMPUTE_HPP
+#define COMPUTE_HPP
+
+#include <cstdint>
+#include <string>
+
+namespace tps {
+
+// Consumer stage that interprets scanned bytes as fixed-width unsigned
+// columns and runs an aggregation kernel over them.
+class Compute {
+ public:
+  enum Kernel { NONE, SUM, MINMAX, COUNT, HASH };
+  enum Isa { AUTO, SCALAR, AVX2, AVX512 };
+
+  Compute(Kernel kernel, size_t column_width, double selectivity, Isa isa);
+
+  // Run the kernel over all complete columns in buf
+  void consume(const char *buf, size_t len);
+
+  // Fold the partial result of another instance into this one
+  void merge(const Compute &other);
+
+  Kernel kernel() const { return kernel_; }
+  Isa isa() const { return isa_; }
+  size_t column_width() const { return width_; }
+  double selectivity() const { return selectivity_; }
+
+  uint64_t values() const { return values_; }
+  uint64_t sum() const { return sum_; }
+  uint64_t min() const { return min_; }
+  uint64_t max() const { return max_; }
+  uint64_t count() const { return count_; }
+  uint64_t hash() const { return hash_; }
+
+  // Human readable result of the selected kernel
+  std::string result() const;
+
+  // Best instruction set supported by the running CPU
+  static Isa detect_isa();
+
+  static bool parse_kernel(const std::string &str, Kernel *kernel);
+  static bool parse_isa(const std::string &str, Isa *isa);
+  static std::string kernel_name(Kernel kernel);
+  static std::string isa_name(Isa isa);
+
+  typedef void (*KernelFn)(const char *buf, size_t n, uint64_t threshold,
+                           Compute *state);
+
+ private:
+  Kernel kernel_;
+  Isa isa_;
+  size_t width_;
+  double selectivity_;
+  uint64_t threshold_;
+  KernelFn fn_;
+
+  uint64_t values_;
+  uint64_t sum_;
+  uint64_t min_;
+  uint64_t max_;
+  uint64_t count_;
+  uint64_t hash_;
+
+  friend struct ComputeKernels;
+};
+
+}  // namespace tps
+
+#endif  // COMPUTE_HPP
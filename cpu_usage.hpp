@@ -0,0 +1,120 @@
+#ifndef CPU_USAGE_HPP
+#define CPU_USAGE_HPP
+
+#include <sys/resource.h>
+
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+
+#include "helper.hpp"
+#include "report.hpp"
+
+namespace tps {
+
+// CPU time, context switches and page faults of one thread, taken with
+// getrusage(RUSAGE_THREAD) so that a delta covers exactly the timed loop
+struct CpuUsage {
+  long long user_ns;
+  long long sys_ns;
+  size_t voluntary_switches;
+  size_t involuntary_switches;
+  size_t minor_faults;
+  size_t major_faults;
+
+  CpuUsage()
+      : user_ns(0),
+        sys_ns(0),
+        voluntary_switches(0),
+        involuntary_switches(0),
+        minor_faults(0),
+        major_faults(0) {}
+
+  // Usage of the calling thread so far
+  static CpuUsage thread() {
+    struct rusage ru;
+    getrusage(RUSAGE_THREAD, &ru);
+    CpuUsage usage;
+    usage.user_ns =
+        ru.ru_utime.tv_sec * 1000000000LL + ru.ru_utime.tv_usec * 1000LL;
+    usage.sys_ns =
+        ru.ru_stime.tv_sec * 1000000000LL + ru.ru_stime.tv_usec * 1000LL;
+    usage.voluntary_switches = static_cast<size_t>(ru.ru_nvcsw);
+    usage.involuntary_switches = static_cast<size_t>(ru.ru_nivcsw);
+    usage.minor_faults = static_cast<size_t>(ru.ru_minflt);
+    usage.major_faults = static_cast<size_t>(ru.ru_majflt);
+    return usage;
+  }
+
+  CpuUsage operator-(const CpuUsage &other) const {
+    CpuUsage usage;
+    usage.user_ns = user_ns - other.user_ns;
+    usage.sys_ns = sys_ns - other.sys_ns;
+    usage.voluntary_switches = voluntary_switches - other.voluntary_switches;
+    usage.involuntary_switches =
+        involuntary_switches - other.involuntary_switches;
+    usage.minor_faults = minor_faults - other.minor_faults;
+    usage.major_faults = major_faults - other.major_faults;
+    return usage;
+  }
+
+  CpuUsage &operator+=(const CpuUsage &other) {
+    user_ns += other.user_ns;
+    sys_ns += other.sys_ns;
+    voluntary_switches += other.voluntary_switches;
+    involuntary_switches += other.involuntary_switches;
+    minor_faults += other.minor_faults;
+    major_faults += other.major_faults;
+    return *this;
+  }
+
+  long long cpu_ns() const { return user_ns + sys_ns; }
+  size_t switches() const { return voluntary_switches + involuntary_switches; }
+  size_t faults() const { return minor_faults + major_faults; }
+};
+
+// Value per operation and per GB (2^30 bytes)
+static double per_op(double value, size_t ops) {
+  return ops == 0 ? 0.0 : value / ops;
+}
+
+static double per_gb(double value, size_t bytes) {
+  return bytes == 0 ? 0.0 : value * 1024 * 1024 * 1024 / bytes;
+}
+
+static void print_cpu_usage(std::ostream &os, const CpuUsage &usage,
+                            size_t ops, size_t bytes) {
+  os << "cpu time: " << usage.user_ns << " ns user, " << usage.sys_ns
+     << " ns sys" << std::endl;
+  os << "context switches: " << usage.voluntary_switches << " voluntary, "
+     << usage.involuntary_switches << " involuntary" << std::endl;
+  os << "page faults: " << usage.minor_faults << " minor, "
+     << usage.major_faults << " major" << std::endl;
+  os << "cpu time per op: " << llround(per_op(usage.cpu_ns(), ops))
+     << " ns, per GB: " << to_ns_per_gb(usage.cpu_ns(), bytes) << " ns"
+     << std::endl;
+  os << "context switches per op: " << per_op(usage.switches(), ops)
+     << ", per GB: " << per_gb(usage.switches(), bytes) << std::endl;
+  os << "page faults per op: " << per_op(usage.faults(), ops)
+     << ", per GB: " << per_gb(usage.faults(), bytes) << std::endl;
+}
+
+static void add_cpu_usage(Report *report, const CpuUsage &usage, size_t ops,
+                          size_t bytes) {
+  report->add_result("user_time_ns", usage.user_ns);
+  report->add_result("sys_time_ns", usage.sys_ns);
+  report->add_result("voluntary_switches", usage.voluntary_switches);
+  report->add_result("involuntary_switches", usage.involuntary_switches);
+  report->add_result("minor_faults", usage.minor_faults);
+  report->add_result("major_faults", usage.major_faults);
+  report->add_result("cpu_ns_per_op", llround(per_op(usage.cpu_ns(), ops)));
+  report->add_result("cpu_ns_per_gb", to_ns_per_gb(usage.cpu_ns(), bytes));
+  report->add_ratio("switches_per_op", per_op(usage.switches(), ops));
+  report->add_ratio("switches_per_gb", per_gb(usage.switches(), bytes));
+  report->add_ratio("faults_per_op", per_op(usage.faults(), ops));
+  report->add_ratio("faults_per_gb", per_gb(usage.faults(), bytes));
+}
+
+}  // namespace tps
+
+#endif  // CPU_USAGE_HPP
@@ -0,0 +1,269 @@
+#ifndef DISK_IO_HPP
+#define DISK_IO_HPP
+
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "report.hpp"
+
+namespace tps {
+
+// I/O of this process from /proc/self/io. rchar and wchar count what
+// read and write calls moved, read_bytes and write_bytes what the process
+// made the block layer fetch or will make it store, readahead included.
+// Children are added once they are reaped.
+struct ProcIo {
+  size_t rchar;
+  size_t wchar;
+  size_t read_bytes;
+  size_t write_bytes;
+  size_t cancelled_write_bytes;
+
+  ProcIo()
+      : rchar(0),
+        wchar(0),
+        read_bytes(0),
+        write_bytes(0),
+        cancelled_write_bytes(0) {}
+
+  // All zero when the kernel has no task I/O accounting
+  static ProcIo self() {
+    ProcIo io;
+    std::ifstream fs("/proc/self/io");
+    std::string key;
+    size_t value;
+    while (fs >> key >> value) {
+      if (key == "rchar:")
+        io.rchar = value;
+      else if (key == "wchar:")
+        io.wchar = value;
+      else if (key == "read_bytes:")
+        io.read_bytes = value;
+      else if (key == "write_bytes:")
+        io.write_bytes = value;
+      else if (key == "cancelled_write_bytes:")
+        io.cancelled_write_bytes = value;
+    }
+    return io;
+  }
+
+  ProcIo operator-(const ProcIo &other) const {
+    ProcIo io;
+    io.rchar = rchar - other.rchar;
+    io.wchar = wchar - other.wchar;
+    io.read_bytes = read_bytes - other.read_bytes;
+    io.write_bytes = write_bytes - other.write_bytes;
+    io.cancelled_write_bytes =
+        cancelled_write_bytes - other.cancelled_write_bytes;
+    return io;
+  }
+};
+
+// Completed requests and bytes of one block device from /proc/diskstats,
+// whoever issued them
+struct DiskStats {
+  size_t reads;
+  size_t read_bytes;
+  size_t writes;
+  size_t write_bytes;
+
+  DiskStats() : reads(0), read_bytes(0), writes(0), write_bytes(0) {}
+
+  DiskStats operator-(const DiskStats &other) const {
+    DiskStats stats;
+    stats.reads = reads - other.reads;
+    stats.read_bytes = read_bytes - other.read_bytes;
+    stats.writes = writes - other.writes;
+    stats.write_bytes = write_bytes - other.write_bytes;
+    return stats;
+  }
+
+  DiskStats &operator+=(const DiskStats &other) {
+    reads += other.reads;
+    read_bytes += other.read_bytes;
+    writes += other.writes;
+    write_bytes += other.write_bytes;
+    return *this;
+  }
+};
+
+// Snapshots of the process and of the devices backing a set of directories
+// around a run. A directory on a filesystem without a block device of its
+// own (tmpfs, overlay, btrfs) has no device and only the process counts.
+class DiskIo {
+ public:
+  struct Device {
+    std::string name;
+    unsigned int major;
+    unsigned int minor;
+    DiskStats before;
+    DiskStats delta;
+  };
+
+  DiskIo() {}
+
+  explicit DiskIo(const std::vector<std::string> &dirs) {
+    for (const std::string &dir : dirs) {
+      struct stat st;
+      if (stat(dir.c_str(), &st) != 0) continue;
+      unsigned int ma = major(st.st_dev);
+      unsigned int mi = minor(st.st_dev);
+      bool seen = false;
+      for (const Device &d : devices_)
+        seen = seen || (d.major == ma && d.minor == mi);
+      if (!seen) devices_.push_back({"", ma, mi, DiskStats(), DiskStats()});
+    }
+    // Keep only the devices diskstats knows, which also names them
+    std::vector<Device> found;
+    for (Device &d : devices_) {
+      if (read_disk_stats(d.major, d.minor, &d.name, &d.before))
+        found.push_back(d);
+    }
+    devices_.swap(found);
+  }
+
+  void begin() {
+    for (Device &d : devices_)
+      read_disk_stats(d.major, d.minor, nullptr, &d.before);
+    proc_before_ = ProcIo::self();
+  }
+
+  void end() {
+    proc_ = ProcIo::self() - proc_before_;
+    for (Device &d : devices_) {
+      DiskStats now;
+      read_disk_stats(d.major, d.minor, nullptr, &now);
+      d.delta = now - d.before;
+    }
+  }
+
+  const ProcIo &proc() const { return proc_; }
+  const std::vector<Device> &devices() const { return devices_; }
+
+  DiskStats device_total() const {
+    DiskStats total;
+    for (const Device &d : devices_) total += d.delta;
+    return total;
+  }
+
+ private:
+  // Fields after the name: reads, reads merged, sectors read, ms reading,
+  // writes, writes merged, sectors written, ... Sectors are 512 bytes.
+  static bool read_disk_stats(unsigned int ma, unsigned int mi,
+                              std::string *name, DiskStats *stats) {
+    std::ifstream fs("/proc/diskstats");
+    std::string line;
+    while (std::getline(fs, line)) {
+      std::istringstream ss(line);
+      unsigned int line_major, line_minor;
+      std::string line_name;
+      size_t reads, reads_merged, read_sectors, read_ms;
+      size_t writes, writes_merged, write_sectors;
+      if (!(ss >> line_major >> line_minor >> line_name >> reads >>
+            reads_merged >> read_sectors >> read_ms >> writes >>
+            writes_merged >> write_sectors))
+        continue;
+      if (line_major != ma || line_minor != mi) continue;
+      if (name) *name = line_name;
+      stats->reads = reads;
+      stats->read_bytes = read_sectors * 512;
+      stats->writes = writes;
+      stats->write_bytes = write_sectors * 512;
+      return true;
+    }
+    return false;
+  }
+
+  ProcIo proc_before_;
+  ProcIo proc_;
+  std::vector<Device> devices_;
+};
+
+// Physical bytes per logical byte the tool moved
+static double amplification(size_t physical, size_t logical) {
+  return logical == 0 ? 0.0 : static_cast<double>(physical) / logical;
+}
+
+static size_t avg_request(size_t bytes, size_t requests) {
+  return requests == 0 ? 0 : bytes / requests;
+}
+
+// logical_read and logical_written are the bytes the tool itself counted
+static void print_disk_io(std::ostream &os, const DiskIo &io,
+                          size_t logical_read, size_t logical_written) {
+  const ProcIo &p = io.proc();
+  os << "process io: rchar " << p.rchar << ", wchar " << p.wchar
+     << ", read_bytes " << p.read_bytes << ", write_bytes " << p.write_bytes
+     << ", cancelled_write_bytes " << p.cancelled_write_bytes << std::endl;
+  for (const DiskIo::Device &d : io.devices()) {
+    os << "device " << d.name << ": " << d.delta.reads << " reads, "
+       << d.delta.read_bytes << " bytes, avg "
+       << avg_request(d.delta.read_bytes, d.delta.reads) << " bytes; "
+       << d.delta.writes << " writes, " << d.delta.write_bytes
+       << " bytes, avg " << avg_request(d.delta.write_bytes, d.delta.writes)
+       << " bytes" << std::endl;
+  }
+  DiskStats total = io.device_total();
+  if (logical_read > 0) {
+    os << "read amplification: process "
+       << amplification(p.read_bytes, logical_read);
+    if (!io.devices().empty())
+      os << ", device " << amplification(total.read_bytes, logical_read);
+    os << std::endl;
+  }
+  if (logical_written > 0) {
+    os << "write amplification: process "
+       << amplification(p.write_bytes, logical_written);
+    if (!io.devices().empty())
+      os << ", device " << amplification(total.write_bytes, logical_written);
+    os << std::endl;
+  }
+}
+
+static void add_disk_io(Report *report, const DiskIo &io,
+                        size_t logical_read, size_t logical_written) {
+  const ProcIo &p = io.proc();
+  report->add_result("io_rchar", p.rchar);
+  report->add_result("io_wchar", p.wchar);
+  report->add_result("io_read_bytes", p.read_bytes);
+  report->add_result("io_write_bytes", p.write_bytes);
+  report->add_result("io_cancelled_write_bytes", p.cancelled_write_bytes);
+  if (!io.devices().empty()) {
+    DiskStats total = io.device_total();
+    report->add_result("device_reads", total.reads);
+    report->add_result("device_read_bytes", total.read_bytes);
+    report->add_result("device_avg_read_bytes",
+                       avg_request(total.read_bytes, total.reads));
+    report->add_result("device_writes", total.writes);
+    report->add_result("device_write_bytes", total.write_bytes);
+    report->add_result("device_avg_write_bytes",
+                       avg_request(total.write_bytes, total.writes));
+  }
+  if (logical_read > 0) {
+    report->add_ratio("read_amplification",
+                      amplification(p.read_bytes, logical_read));
+    if (!io.devices().empty())
+      report->add_ratio(
+          "device_read_amplification",
+          amplification(io.device_total().read_bytes, logical_read));
+  }
+  if (logical_written > 0) {
+    report->add_ratio("write_amplification",
+                      amplification(p.write_bytes, logical_written));
+    if (!io.devices().empty())
+      report->add_ratio(
+          "device_write_amplification",
+          amplification(io.device_total().write_bytes, logical_written));
+  }
+}
+
+}  // namespace tps
+
+#endif  // DISK_IO_HPP
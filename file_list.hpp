@@ -0,0 +1,334 @@
+#ifndef FILE_LIST_HPP
+#define FILE_LIST_HPP
+
+#include <errno.h>
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "helper.hpp"
+#include "io_exception.hpp"
+#include "report.hpp"
+
+namespace tps {
+
+// Binary manifest that file_write leaves next to the files. It holds the
+// sorted names and sizes and the directory mtime taken after it was
+// written, so adding, removing or renaming a file invalidates it.
+//   header, num_files entries, names
+struct ManifestHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t entry_size;
+  uint64_t num_files;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  uint64_t names_size;
+};
+
+struct ManifestEntry {
+  uint64_t size;
+  uint64_t name_off;
+  uint32_t name_len;
+  uint32_t reserved;
+};
+
+static const char MANIFEST_NAME[] = ".tps_manifest";
+static const char MANIFEST_MAGIC[8] = {'T', 'P', 'S', 'M', 'A', 'N', 'I', 'F'};
+static const uint32_t MANIFEST_VERSION = 1;
+
+static bool dir_mtime(const std::string &dir_path, int64_t *sec,
+                      int64_t *nsec) {
+  struct stat st;
+  if (stat(dir_path.c_str(), &st) != 0) return false;
+  *sec = st.st_mtim.tv_sec;
+  *nsec = st.st_mtim.tv_nsec;
+  return true;
+}
+
+// Names in the order given, sizes[i] belongs to names[i]
+static void write_manifest(const std::string &dir_path,
+                           const std::vector<std::string> &names,
+                           const std::vector<size_t> &sizes) {
+  std::vector<size_t> order(names.size());
+  for (size_t i = 0; i < order.size(); i++) order[i] = i;
+  std::sort(order.begin(), order.end(),
+            [&names](size_t a, size_t b) { return names[a] < names[b]; });
+
+  ManifestHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MANIFEST_MAGIC, sizeof(header.magic));
+  header.version = MANIFEST_VERSION;
+  header.entry_size = sizeof(ManifestEntry);
+  header.num_files = names.size();
+
+  std::vector<ManifestEntry> entries(names.size());
+  std::string blob;
+  for (size_t i = 0; i < order.size(); i++) {
+    const std::string &name = names[order[i]];
+    entries[i].size = sizes[order[i]];
+    entries[i].name_off = blob.size();
+    entries[i].name_len = static_cast<uint32_t>(name.size());
+    entries[i].reserved = 0;
+    blob += name;
+  }
+  header.names_size = blob.size();
+
+  std::string path = dir_path + "/" + MANIFEST_NAME;
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1)
+    throw IOException("Failed to create " + path + ", error " +
+                      std::to_string(errno));
+  auto write_all = [fd, &path](const void *data, size_t len, off_t off) {
+    const char *p = static_cast<const char *>(data);
+    while (len > 0) {
+      ssize_t n = pwrite(fd, p, len, off);
+      if (n <= 0) {
+        int err = errno;
+        close(fd);
+        throw IOException("Failed to write " + path + ", error " +
+                          std::to_string(err));
+      }
+      p += n;
+      len -= n;
+      off += n;
+    }
+  };
+  off_t entries_off = sizeof(header);
+  off_t names_off = entries_off + entries.size() * sizeof(ManifestEntry);
+  write_all(entries.data(), entries.size() * sizeof(ManifestEntry),
+            entries_off);
+  write_all(blob.data(), blob.size(), names_off);
+  // Creating the manifest changed the mtime, rewriting its header does not
+  if (!dir_mtime(dir_path, &header.mtime_sec, &header.mtime_nsec)) {
+    close(fd);
+    throw IOException("Failed to stat " + dir_path);
+  }
+  write_all(&header, sizeof(header), 0);
+  close(fd);
+}
+
+// How reader threads share the directories of a file list. GLOBAL threads
+// pick from the union of all files, PER_DIR threads are dealt round-robin
+// to the directories and only read the files of theirs.
+enum class Placement { GLOBAL, PER_DIR };
+
+static bool parse_placement(const std::string &str, Placement *placement) {
+  std::string value = to_lower(str);
+  if (value.compare("global") == 0)
+    *placement = Placement::GLOBAL;
+  else if (value.compare("per-dir") == 0)
+    *placement = Placement::PER_DIR;
+  else
+    return false;
+  return true;
+}
+
+static std::string placement_name(Placement placement) {
+  return placement == Placement::PER_DIR ? "per-dir" : "global";
+}
+
+// Directories of a "dir1,dir2,..." list
+static std::vector<std::string> split_dirs(const std::string &dir_list) {
+  std::vector<std::string> dirs;
+  std::stringstream ss(dir_list);
+  std::string dir;
+  while (std::getline(ss, dir, ','))
+    if (!dir.empty()) dirs.push_back(dir);
+  return dirs;
+}
+
+// Bytes moved to or from one directory of a striped run in time ns
+static void print_dir_throughput(std::ostream &os, const std::string &dir,
+                                 size_t bytes, long long time) {
+  os << "dir: " << dir << ", size: " << bytes << " bytes, throughput: "
+     << to_bytes_per_sec(bytes, time) << " bytes/sec" << std::endl;
+}
+
+static void add_dir_throughput(Report *report, size_t index, size_t bytes,
+                               long long time) {
+  std::string key = "dir_" + std::to_string(index);
+  report->add_result(key + "_bytes", bytes);
+  report->add_result(key + "_bytes_per_sec", to_bytes_per_sec(bytes, time));
+}
+
+// The .bin files of one or more directories and their sizes, listed once so
+// that the points of a sweep share them. Files are sorted within their
+// directory and the directories keep the order they were given in.
+struct FileList {
+  static constexpr size_t MAX_DIRS = 256;
+
+  std::string dir;  // as given, directories separated by commas
+  std::vector<std::string> dirs;
+  std::vector<std::string> files;
+  std::vector<size_t> file_sizes;
+  std::vector<uint32_t> file_dirs;  // index into dirs
+  // Files of dirs[d] are [dir_begin[d], dir_begin[d + 1])
+  std::vector<size_t> dir_begin;
+  bool from_manifest;
+
+  FileList() : from_manifest(false) {}
+
+  static std::shared_ptr<const FileList> load(const std::string &dir_list) {
+    std::shared_ptr<FileList> list = std::make_shared<FileList>();
+    list->dir = dir_list;
+    list->dirs = split_dirs(dir_list);
+    if (list->dirs.empty()) throw IOException("No directory given");
+    if (list->dirs.size() > MAX_DIRS)
+      throw IOException("More than " + std::to_string(MAX_DIRS) +
+                        " directories given");
+    list->from_manifest = true;
+    for (size_t d = 0; d < list->dirs.size(); d++) {
+      FileList one;
+      one.dir = list->dirs[d];
+      one.load_dir();
+      list->dir_begin.push_back(list->files.size());
+      list->files.insert(list->files.end(), one.files.begin(),
+                         one.files.end());
+      list->file_sizes.insert(list->file_sizes.end(), one.file_sizes.begin(),
+                              one.file_sizes.end());
+      list->file_dirs.insert(list->file_dirs.end(), one.files.size(),
+                             static_cast<uint32_t>(d));
+      if (!one.from_manifest) list->from_manifest = false;
+    }
+    list->dir_begin.push_back(list->files.size());
+    return list;
+  }
+
+ private:
+  void load_dir() {
+    bool is_dir;
+    bool exists = file_exists(dir, &is_dir);
+    if (!exists) throw IOException("Directory not exists: " + dir);
+    if (!is_dir) throw IOException("Not a directory: " + dir);
+
+    if (read_manifest()) return;
+    enumerate();
+    if (files.empty()) throw IOException("Empty directory: " + dir);
+  }
+
+  // False if there is no manifest or it does not match the directory
+  bool read_manifest() {
+    std::string path = dir + "/" + MANIFEST_NAME;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        static_cast<size_t>(st.st_size) < sizeof(ManifestHeader)) {
+      close(fd);
+      return false;
+    }
+    size_t len = static_cast<size_t>(st.st_size);
+    void *mem = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) return false;
+
+    const char *base = static_cast<const char *>(mem);
+    const ManifestHeader *h = reinterpret_cast<const ManifestHeader *>(base);
+    int64_t sec, nsec;
+    size_t entries_len = h->num_files * sizeof(ManifestEntry);
+    bool valid = memcmp(h->magic, MANIFEST_MAGIC, sizeof(h->magic)) == 0 &&
+                 h->version == MANIFEST_VERSION &&
+                 h->entry_size == sizeof(ManifestEntry) &&
+                 h->num_files > 0 &&
+                 h->num_files < len / sizeof(ManifestEntry) &&
+                 sizeof(ManifestHeader) + entries_len + h->names_size == len &&
+                 dir_mtime(dir, &sec, &nsec) && sec == h->mtime_sec &&
+                 nsec == h->mtime_nsec;
+    if (valid) {
+      const ManifestEntry *entries = reinterpret_cast<const ManifestEntry *>(
+          base + sizeof(ManifestHeader));
+      const char *names = base + sizeof(ManifestHeader) + entries_len;
+      files.reserve(h->num_files);
+      file_sizes.reserve(h->num_files);
+      for (size_t i = 0; valid && i < h->num_files; i++) {
+        const ManifestEntry &e = entries[i];
+        if (e.name_off + e.name_len > h->names_size) {
+          valid = false;
+          break;
+        }
+        files.emplace_back(names + e.name_off, e.name_len);
+        file_sizes.push_back(e.size);
+      }
+    }
+    munmap(mem, len);
+    if (!valid) {
+      files.clear();
+      file_sizes.clear();
+    }
+    from_manifest = valid;
+    return valid;
+  }
+
+  // Names through getdents64 with a large buffer, then sizes from fstatat
+  // split over threads in contiguous batches
+  void enumerate() {
+    int dir_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dir_fd == -1)
+      throw IOException("Failed to open " + dir + ", error " +
+                        std::to_string(errno));
+    std::vector<char> buf(1 << 20);
+    while (true) {
+      long n = syscall(SYS_getdents64, dir_fd, buf.data(), buf.size());
+      if (n == -1) {
+        int err = errno;
+        close(dir_fd);
+        throw IOException("Failed to list " + dir + ", error " +
+                          std::to_string(err));
+      }
+      if (n == 0) break;
+      for (long off = 0; off < n;) {
+        // struct linux_dirent64 is not exported by the libc headers
+        const char *ent = buf.data() + off;
+        uint16_t reclen;
+        memcpy(&reclen, ent + 16, sizeof(reclen));
+        const char *name = ent + 19;
+        size_t name_len = strlen(name);
+        if (name_len >= 4 && strcasecmp(name + name_len - 4, ".bin") == 0)
+          files.emplace_back(name, name_len);
+        off += reclen;
+      }
+    }
+    std::sort(files.begin(), files.end());
+
+    file_sizes.assign(files.size(), 0);
+    size_t num_threads = std::min<size_t>(
+        std::max(1u, std::thread::hardware_concurrency()),
+        files.size() / 4096 + 1);
+    size_t batch = (files.size() + num_threads - 1) / num_threads;
+    auto stat_batch = [this, dir_fd, batch](size_t t) {
+      size_t end = std::min(files.size(), (t + 1) * batch);
+      for (size_t i = t * batch; i < end; i++) {
+        struct stat st;
+        if (fstatat(dir_fd, files[i].c_str(), &st, 0) != 0 ||
+            !S_ISREG(st.st_mode))
+          file_sizes[i] = (size_t)-1;
+        else
+          file_sizes[i] = static_cast<size_t>(st.st_size);
+      }
+    };
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < num_threads; t++)
+      threads.emplace_back(stat_batch, t);
+    stat_batch(0);
+    for (std::thread &t : threads) t.join();
+    close(dir_fd);
+  }
+};
+
+}  // namespace tps
+
+#endif  // FILE_LIST_HPP
@@ -1,11 +1,10 @@
 #include "file_lookup.hpp"
 
-#include <fcntl.h>
-
 #include <cmath>
 #include <random>
 #include <thread>
 
+#include "perf_counter.hpp"
 #include "timer.hpp"
 
 namespace tps {
@@ -14,9 +13,27 @@ FileLookup::FileLookup(const std::string dir_path, size_t record_size,
                        long long max_time, bool buffered, int num_threads)
     : FileRead(dir_path, record_size, max_time, buffered, num_threads) {}
 
+FileLookup::FileLookup(std::shared_ptr<const FileList> list,
+                       size_t record_size, long long max_time, bool buffered,
+                       int num_threads)
+    : FileRead(list, record_size, max_time, buffered, num_threads) {}
+
 void FileLookup::start_read() {
+  begin_cache();
+  begin_trace();
+  if (procs_ > 1)
+    run_procs();
+  else
+    run_threads();
+  end_trace();
+  end_cache();
+}
+
+void FileLookup::run_threads() {
+  start_live(num_threads_);
   if (num_threads_ < 2) {
-    do_read();
+    do_read(0);
+    stop_live();
     return;
   }
 
@@ -24,65 +41,163 @@ void FileLookup::start_read() {
   threads.reserve(num_threads_);
 
   for (int i = 0; i < num_threads_; i++)
-    threads.emplace_back(&FileLookup::do_read, this);
+    threads.emplace_back(&FileLookup::do_read, this, i);
 
   for (int i = 0; i < num_threads_; i++) threads[i].join();
+  stop_live();
 }
 
-void FileLookup::do_read() {
+void FileLookup::do_read(int thread) {
+  apply_io_priority(io_priority_);
+  switch (engine_) {
+    case Engine::PREAD:
+      do_read_with<PreadEngine>(thread);
+      break;
+    case Engine::PREADV:
+      do_read_with<PreadvEngine>(thread);
+      break;
+    case Engine::MMAP:
+      do_read_with<MmapEngine>(thread);
+      break;
+    case Engine::SPLICE:
+      do_read_with<SpliceEngine>(thread);
+      break;
+    case Engine::SENDFILE:
+      do_read_with<SendfileEngine>(thread);
+      break;
+    case Engine::URING:
+      do_read_with<UringEngine>(thread);
+      break;
+    default:
+      do_read_with<ReadEngine>(thread);
+      break;
+  }
+}
+
+template <class IoEngine>
+void FileLookup::do_read_with(int thread) {
   size_t local_ops = 0;
   size_t local_bytes = 0;
 
   std::random_device rd;
   std::mt19937 gen(rd());
-  std::uniform_int_distribution<size_t> file_dist(0, files_.size() - 1);
+  size_t first_file, num_files;
+  worker_files(thread, &first_file, &num_files);
+  std::uniform_int_distribution<size_t> file_dist(first_file,
+                                                  first_file + num_files - 1);
   std::uniform_real_distribution<double> pos_dist(0.0, 1.0);
 
-  size_t blk_size = get_block_size();
-  bool single_file = files_.size() == 1;
+  size_t blk_size = block_size_;
+  bool single_file = num_files == 1;
+  std::vector<size_t> local_dir_bytes(dirs_.size(), 0);
+  std::vector<size_t> warm_dir_bytes(dirs_.size(), 0);
   size_t buf_size =
       buffered_ ? record_size_ : align_buf(record_size_, blk_size);
-  char *buf = new char[buf_size];
-
-  int flags = O_RDONLY;
-  if (!buffered_) flags |= O_DIRECT;
-
-  HighResTimer timer;
+  IoEngine engine(engine_config(buf_size, 1, true));
+  LiveCounter live(live_->slot(thread));
+  TraceLog trace = make_trace_log(thread);
+  RatePacer pacer = make_pacer();
+  long long op_start = 0;
+  if (!engine.fixed_buffers()) fixed_buffers_ = false;
+
+  // Counts at the end of warm-up, the results start from there
+  WarmupWindow warmup = make_warmup();
+  size_t warm_ops = 0;
+  size_t warm_bytes = 0;
+  long long warm_time = 0;
+
+  CpuUsage usage_start = CpuUsage::thread();
+  PerfGroup perf(counters_);
+  perf.start();
+
+  // The clock is read per op only for latencies and warm-up, the
+  // end of the run is the watchdog's flag
+  bool latencies = has_latency();
+  TscTimer timer;
   timer.start();
-  while (true) {
-    size_t ridx = single_file ? 0 : file_dist(gen);
-    std::string picked_file = dir_ + "/" + files_[ridx];
+  while (!run_.stopped()) {
+    // Time held back by the rate limit is not part of the op's latency
+    if (pacer.on()) {
+      pacer.pay(buf_size, run_);
+      if (latencies || warmup.active()) {
+        timer.stop();
+        op_start = timer.elapsed_ns();
+      }
+    }
+    size_t ridx = single_file ? first_file : file_dist(gen);
     size_t picked_size = file_sizes_[ridx];
     size_t rpos = std::min(picked_size - std::min(record_size_, picked_size),
                            get_round(pos_dist(gen), 0, picked_size - 1));
     if (!buffered_) rpos = align_floor(rpos, blk_size);
 
-    int fd;
-    if ((fd = open(picked_file.c_str(), flags)) == -1)
-      throw IOException("Filed to open " + files_[ridx] + ", error " +
+    int t;
+    if ((t = engine.open(file_dir_fd(ridx), files_[ridx].c_str(),
+                         picked_size)) == -1)
+      throw IOException("Filed to open " + file_path(ridx) + ", error " +
                         std::to_string(errno));
-    if (rpos > 0 && lseek(fd, rpos, SEEK_SET) == -1)
-      throw IOException("Filed to seek " + files_[ridx] + ", error " +
+    if (trace.on()) trace.add(TRACE_READ, ridx, rpos, buf_size);
+    if (!engine.submit(t, rpos, buf_size))
+      throw IOException("Filed to seek " + file_path(ridx) + ", error " +
                         std::to_string(errno));
-    size_t bytes_read = read(fd, buf, buf_size);
+    const char *data;
+    size_t bytes_read = engine.reap(t, nullptr, &data);
     if (bytes_read == IO_ERROR)
-      throw IOException("Filed to read " + files_[ridx] + ", error " +
+      throw IOException("Filed to read " + file_path(ridx) + ", error " +
                         std::to_string(errno));
-    close(fd);
+    engine.close(t);
 
     local_ops++;
     local_bytes += bytes_read;
+    local_dir_bytes[file_dirs_[ridx]] += bytes_read;
 
+    live.add_bytes(bytes_read);
+    if (!latencies && !warmup.active()) {
+      live.add_op(0);
+      continue;
+    }
     timer.stop();
-    if (timer.elapsed_ns() >= max_time_) break;
+    long long op_end = timer.elapsed_ns();
+    live.add_op(op_end - op_start);
+    op_start = op_end;
+    if (warmup.active() && warmup.end(local_ops, op_end)) {
+      warm_ops = local_ops;
+      warm_bytes = local_bytes;
+      warm_time = op_end;
+      warm_dir_bytes = local_dir_bytes;
+      live.end_warmup();
+      usage_start = CpuUsage::thread();
+      perf.start();
+      run_.arm(max_time_);
+    }
   }
-  delete[] buf;
-
-  update_stats(timer.elapsed_ns(), local_ops, local_bytes);
+  timer.stop();
+  // Stopped before this worker left warm-up, nothing of it is measured
+  if (warmup.active()) {
+    warm_ops = local_ops;
+    warm_bytes = local_bytes;
+    warm_time = timer.elapsed_ns();
+    warm_dir_bytes = local_dir_bytes;
+    live.end_warmup();
+    usage_start = CpuUsage::thread();
+    perf.start();
+  }
+  perf.stop();
+  CpuUsage usage = CpuUsage::thread() - usage_start;
+
+  update_stats(thread, timer.elapsed_ns() - warm_time, local_ops - warm_ops,
+               local_bytes - warm_bytes);
+  for (size_t d = 0; d < dirs_.size(); d++)
+    local_dir_bytes[d] -= warm_dir_bytes[d];
+  add_dir_bytes(local_dir_bytes);
+  add_trace(trace.records());
+  record_warmup(warm_ops, warm_bytes, warm_time, warmup.by_steady());
+  update_usage(usage, perf.counts());
 }
 
-void FileLookup::update_stats(long long time, size_t ops, size_t bytes) {
+void FileLookup::update_stats(int thread, long long time, size_t ops,
+                              size_t bytes) {
   const std::lock_guard<std::mutex> lock(mtx_);
+  record_thread({thread, ops, bytes, ops, ops, time});
   if (time > total_time_) total_time_ = time;
   total_ops_ += ops;
   total_records_ += ops;
@@ -90,13 +205,25 @@ void FileLookup::update_stats(long long time, size_t ops, size_t bytes) {
 }
 
 void FileLookup::print_arguments() {
+  arguments_.clear();
   print_argument("page-size", get_page_size());
-  print_argument("block-size", get_block_size());
+  print_argument("block-size", block_size_);
   print_argument("dir", dir_);
   print_argument("record-size", record_size_);
   print_argument("max-time", std::to_string(max_time_));
   print_argument("buffered", buffered_);
   print_argument("threads", std::to_string(num_threads_));
+  print_dir_arguments();
+  if (procs_ > 1) print_argument("procs", std::to_string(procs_));
+  print_class_arguments();
+  print_argument("hugepages", huge_pages_name(huge_pages_));
+  print_argument("engine", engine_name(engine_));
+  if (counters_) print_argument("counters", counters_);
+  if (cache_mode_ != CacheMode::AS_IS)
+    print_argument("cache", cache_mode_name(cache_mode_));
+  if (mem_limit_ > 0) print_argument("mem-limit", mem_limit_);
+  if (!trace_path_.empty()) print_argument("trace", trace_path_);
+  print_warmup_arguments();
 }
 
 }  // namespace tps
\ No newline at end of file
@@ -1,6 +1,7 @@
 #ifndef FILE_LOOKUP_HPP
 #define FILE_LOOKUP_HPP
 
+#include <memory>
 #include <mutex>
 #include <string>
 
@@ -15,13 +16,20 @@ class FileLookup : public FileRead {
   FileLookup(const std::string dir_path, size_t record_size, long long max_time,
              bool buffered, int num_threads);
 
+  // Reads the files of a list loaded before, e.g. by an earlier sweep point
+  FileLookup(std::shared_ptr<const FileList> list, size_t record_size,
+             long long max_time, bool buffered, int num_threads);
+
   void start_read();
 
   void print_arguments();
 
  private:
-  void do_read();
-  void update_stats(long long time, size_t ops, size_t bytes);
+  void run_threads();
+  void do_read(int thread);
+  template <class IoEngine>
+  void do_read_with(int thread);
+  void update_stats(int thread, long long time, size_t ops, size_t bytes);
 };
 
 }  // namespace tps
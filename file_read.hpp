@@ -1,13 +1,42 @@
 #ifndef FILE_READ_HPP
 #define FILE_READ_HPP
 
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <cmath>
+#include <mutex>
+#include <new>
+#include <sstream>
 #include <string>
 #include <vector>
 
+#include "balloon.hpp"
+#include "buffer.hpp"
+#include "cache.hpp"
+#include "cpu_usage.hpp"
+#include "disk_io.hpp"
+#include "file_list.hpp"
 #include "helper.hpp"
+#include "io_engine.hpp"
 #include "io_exception.hpp"
+#include "io_priority.hpp"
+#include "live_stats.hpp"
+#include "perf_counter.hpp"
+#include "rate_limit.hpp"
+#include "report.hpp"
+#include "run_control.hpp"
+#include "timer.hpp"
+#include "trace.hpp"
+#include "warmup.hpp"
 
 namespace tps {
 
@@ -15,33 +44,84 @@ class FileRead {
  public:
   FileRead(const std::string dir_path, size_t record_size, long long max_time,
            bool buffered, int num_threads)
-      : dir_(dir_path),
+      : FileRead(FileList::load(dir_path), record_size, max_time, buffered,
+                 num_threads) {}
+
+  FileRead(std::shared_ptr<const FileList> list, size_t record_size,
+           long long max_time, bool buffered, int num_threads)
+      : dir_(list->dir),
         record_size_(record_size),
         max_time_(max_time),
         buffered_(buffered),
         num_threads_(num_threads),
+        dirs_(list->dirs),
+        files_(list->files),
+        file_sizes_(list->file_sizes),
+        file_dirs_(list->file_dirs),
+        dir_begin_(list->dir_begin),
+        dir_bytes_(list->dirs.size(), 0),
+        placement_(Placement::GLOBAL),
         total_ops_(0),
         total_records_(0),
         total_time_(0),
-        total_bytes_(0) {
-    bool is_dir;
-    bool exists = file_exists(dir_, &is_dir);
-    if (!exists) throw IOException("Directory not exists: " + dir_);
-    if (!is_dir) throw IOException("Not a directory: " + dir_);
-
-    for (std::string f : list_dir(dir_)) {
-      if (has_suffix(f, ".bin", false)) {
-        files_.push_back(f);
-        size_t fsize = get_file_size(dir_ + "/" + f);
-        if (fsize % record_size_ != 0)
-          throw IOException("Invalid file: " + f +
-                            ", file size: " + std::to_string(fsize) +
-                            ", record size: " + std::to_string(record_size_));
-        file_sizes_.push_back(fsize);
+        total_bytes_(0),
+        huge_pages_(HugePages::OFF),
+        counters_(false),
+        procs_(1),
+        proc_(-1),
+        thread_base_(0),
+        cache_mode_(CacheMode::AS_IS),
+        cache_before_(0.0),
+        cache_after_(0.0),
+        mem_limit_(0),
+        disk_io_(list->dirs),
+        engine_(Engine::READ),
+        chunk_size_(0),
+        engine_depth_(1),
+        fixed_buffers_(true),
+        output_(Output::TEXT),
+        interval_(0),
+        warmup_time_(0),
+        warmup_ops_(0),
+        steady_cv_(0.0),
+        total_warmup_ops_(0),
+        total_warmup_bytes_(0),
+        total_warmup_time_(0),
+        warmup_steady_(false),
+        steady_time_(-1),
+        steady_cv_last_(0.0),
+        record_latency_(false),
+        rate_limit_(0) {
+    for (size_t i = 0; i < files_.size(); i++) {
+      if (file_sizes_[i] % record_size_ != 0)
+        throw IOException("Invalid file: " + files_[i] + ", file size: " +
+                          std::to_string(file_sizes_[i]) +
+                          ", record size: " + std::to_string(record_size_));
+    }
+
+    // Files are opened relative to their directory, so the hot loops never
+    // build paths. O_DIRECT alignment is the strictest of the filesystems
+    // that hold the files.
+    dio_mem_align_ = 0;
+    block_size_ = 0;
+    for (const std::string &d : dirs_) {
+      int fd = open(d.c_str(), O_RDONLY | O_DIRECTORY);
+      if (fd == -1) {
+        int err = errno;
+        for (int f : dir_fds_) close(f);
+        throw IOException("Failed to open " + d + ", error " +
+                          std::to_string(err));
       }
+      dir_fds_.push_back(fd);
+      size_t mem_align, offset_align;
+      get_dio_align(d, &mem_align, &offset_align);
+      dio_mem_align_ = std::max(dio_mem_align_, mem_align);
+      block_size_ = std::max(block_size_, offset_align);
     }
-    if (files_.empty()) throw IOException("Empty directory: " + dir_);
-    std::sort(files_.begin(), files_.end());
+  }
+
+  virtual ~FileRead() {
+    for (int fd : dir_fds_) close(fd);
   }
 
   virtual void start_read() = 0;
@@ -51,6 +131,94 @@ class FileRead {
   long long total_time() const { return total_time_; }
   size_t total_bytes() const { return total_bytes_; }
 
+  // Back all I/O buffers with huge pages
+  void set_huge_pages(HugePages mode) { huge_pages_ = mode; }
+
+  // Select the engine, chunk_size of 0 keeps the default read size and depth
+  // is the number of chunks in flight per file for uring
+  void set_engine(Engine engine, size_t chunk_size, size_t depth) {
+    engine_ = engine;
+    chunk_size_ = chunk_size;
+    engine_depth_ = std::max<size_t>(1, depth);
+  }
+
+  // False if the kernel refused to register io_uring buffers
+  bool fixed_buffers() const { return fixed_buffers_; }
+
+  // Count cycles, instructions and LLC misses next to the dTLB misses
+  void set_counters(bool counters) { counters_ = counters; }
+
+  // Fork procs worker processes that run num_threads threads each instead
+  // of running the threads in this process
+  void set_procs(int procs) { procs_ = std::max(1, procs); }
+
+  // Threads read the union of all directories or only their own one
+  void set_placement(Placement placement) { placement_ = placement; }
+
+  // Bytes read from each directory in the results
+  const std::vector<std::string> &dirs() const { return dirs_; }
+  const std::vector<size_t> &dir_bytes() const { return dir_bytes_; }
+
+  // Per directory throughput over the run time, only when there are several
+  void print_dir_results(std::ostream &os) const {
+    if (dirs_.size() < 2) return;
+    for (size_t d = 0; d < dirs_.size(); d++)
+      print_dir_throughput(os, dirs_[d], dir_bytes_[d], total_time_);
+  }
+
+  void add_dir_results(Report *report) const {
+    if (dirs_.size() < 2) return;
+    for (size_t d = 0; d < dirs_.size(); d++)
+      add_dir_throughput(report, d, dir_bytes_[d], total_time_);
+  }
+
+  // Time every operation, as interval reports do, so that latency
+  // percentiles of the whole run are known. Warm-up is left out.
+  void set_record_latency(bool record) { record_latency_ = record; }
+  bool has_latency() const { return record_latency_ || interval_ > 0; }
+  uint64_t latency(double p) const {
+    return latency_counts_.empty()
+               ? 0
+               : LatencyBuckets::percentile(latency_counts_.data(), p);
+  }
+
+  // Cap the bytes per second of the whole run, every worker keeps to its
+  // share. 0 for no cap.
+  void set_rate_limit(size_t bytes_per_sec) { rate_limit_ = bytes_per_sec; }
+
+  // I/O scheduling class of the worker threads
+  void set_io_priority(const IoPriority &prio) { io_priority_ = prio; }
+
+  // Record every read issued by the run to a trace file
+  void set_trace(const std::string &path) { trace_path_ = path; }
+
+  // Evict or pre-read the files before the run
+  void set_cache(CacheMode mode) { cache_mode_ = mode; }
+
+  // Fraction of the file bytes in the page cache before and after the run
+  double cache_before() const { return cache_before_; }
+  double cache_after() const { return cache_after_; }
+
+  // Hold memory during the run so that only about limit bytes stay
+  // available to the page cache, 0 for no balloon
+  void set_mem_limit(size_t limit) { mem_limit_ = limit; }
+  bool has_mem_limit() const { return mem_limit_ > 0; }
+  const MemoryBalloon &balloon() const { return balloon_; }
+
+  // Process and device I/O over the run, set against the bytes read
+  // including warm-up
+  const DiskIo &disk_io() const { return disk_io_; }
+  size_t logical_bytes() const { return total_bytes_ + total_warmup_bytes_; }
+
+  // CPU time, context switches, page faults and hardware counters of all
+  // threads in the timed loops
+  const CpuUsage &cpu_usage() const { return total_usage_; }
+  long long user_time() const { return total_usage_.user_ns; }
+  long long sys_time() const { return total_usage_.sys_ns; }
+  size_t minor_faults() const { return total_usage_.minor_faults; }
+  size_t major_faults() const { return total_usage_.major_faults; }
+  const PerfCounts &perf_counts() const { return total_perf_; }
+
   static size_t align_buf(size_t record_size, size_t blk_size) {
     size_t r;
     for (r = blk_size; r < record_size; r += blk_size) {
@@ -84,29 +252,100 @@ class FileRead {
 
   static constexpr size_t IO_ERROR = (size_t)-1;
 
+  // Print the throughput and latency of every interval while running, to
+  // stderr when the results are JSON or CSV
+  void set_interval(long long interval_ns) { interval_ = interval_ns; }
+
+  // Leave the first time or ops of every run out of the results. With a
+  // steady_cv above 0 warm-up also ends once the coefficient of variation of
+  // the interval throughput drops below it, and is capped by max_time when
+  // neither time nor ops is set.
+  void set_warmup(long long time, size_t ops, double steady_cv) {
+    warmup_time_ = time;
+    warmup_ops_ = ops;
+    steady_cv_ = steady_cv;
+  }
+
+  bool has_warmup() const {
+    return warmup_time_ > 0 || warmup_ops_ > 0 || steady_cv_ > 0.0;
+  }
+
+  // What all threads did before the results started counting, the time is
+  // that of the slowest thread
+  size_t warmup_ops() const { return total_warmup_ops_; }
+  size_t warmup_bytes() const { return total_warmup_bytes_; }
+  long long warmup_time() const { return total_warmup_time_; }
+
+  // Whether and when the steady state detector ended warm-up, a cap may
+  // end it first
+  bool steady() const { return warmup_steady_; }
+  long long steady_time() const {
+    return warmup_steady_ ? steady_time_ : -1;
+  }
+  double steady_cv() const { return steady_cv_last_; }
+
+  void print_warmup(std::ostream &os) const {
+    os << "warm-up: operations: " << total_warmup_ops_
+       << ", time: " << total_warmup_time_
+       << " ns, size: " << total_warmup_bytes_ << " bytes, throughput: "
+       << to_bytes_per_sec(total_warmup_bytes_, total_warmup_time_)
+       << " bytes/sec" << std::endl;
+    if (steady_cv_ <= 0.0) return;
+    if (steady())
+      os << "steady state: reached after " << steady_time()
+         << " ns, cv: " << steady_cv() << std::endl;
+    else
+      os << "steady state: not reached, last cv: " << steady_cv()
+         << std::endl;
+  }
+
+  void add_warmup_results(Report *report) const {
+    report->add_result("warmup_operations", total_warmup_ops_);
+    report->add_result("warmup_time_ns", total_warmup_time_);
+    report->add_result("warmup_bytes", total_warmup_bytes_);
+    report->add_result(
+        "warmup_bytes_per_sec",
+        to_bytes_per_sec(total_warmup_bytes_, total_warmup_time_));
+    if (steady_cv_ > 0.0) report->add_result("steady_time_ns", steady_time());
+  }
+
+  // Arguments are recorded for structured output and only printed as text
+  void set_output(Output output) { output_ = output; }
+
   void print_argument(const std::string &key, const std::string &value) {
-    std::cout << "# " << key << " = " << value << std::endl;
+    arguments_.push_back({key, value});
+    if (output_ == Output::TEXT)
+      std::cout << "# " << key << " = " << value << std::endl;
   }
 
   void print_argument(const std::string &key, size_t value) {
-    std::cout << "# " << key << " = " << value << std::endl;
+    print_argument(key, std::to_string(value));
   }
 
   void print_argument(const std::string &key, bool value) {
-    std::cout << "# " << key << " = " << (value ? "true" : "false")
-              << std::endl;
+    print_argument(key, std::string(value ? "true" : "false"));
   }
 
   void print_argument(const std::string &key, size_t v1, size_t v2) {
-    std::cout << "# " << key << " = [" << v1 << ", " << v2 << "]" << std::endl;
+    print_argument(key, "[" + std::to_string(v1) + ", " +
+                            std::to_string(v2) + "]");
   }
 
   void print_argument(const std::string &key, double v1, double v2) {
-    std::cout << "# " << key << " = [" << v1 << ", " << v2 << "]" << std::endl;
+    std::ostringstream ss;
+    ss << "[" << v1 << ", " << v2 << "]";
+    print_argument(key, ss.str());
   }
 
   virtual void print_arguments() = 0;
 
+  const Arguments &arguments() const { return arguments_; }
+
+  // Stats of every reader thread, indexed by thread
+  const std::vector<ThreadStats> &thread_stats() const {
+    return thread_stats_;
+  }
+
  protected:
   std::string dir_;
   size_t record_size_;
@@ -114,12 +353,397 @@ class FileRead {
   bool buffered_;
   int num_threads_;
   std::mutex mtx_;
+  std::vector<std::string> dirs_;
+  std::vector<int> dir_fds_;
+  size_t block_size_;
+  size_t dio_mem_align_;
   std::vector<std::string> files_;
   std::vector<size_t> file_sizes_;
+  std::vector<uint32_t> file_dirs_;
+  std::vector<size_t> dir_begin_;
+  std::vector<size_t> dir_bytes_;
+  Placement placement_;
   size_t total_ops_;
   size_t total_records_;
   long long total_time_;
   size_t total_bytes_;
+  HugePages huge_pages_;
+  CpuUsage total_usage_;
+  bool counters_;
+  PerfCounts total_perf_;
+  int procs_;
+  int proc_;
+  int thread_base_;
+  CacheMode cache_mode_;
+  double cache_before_;
+  double cache_after_;
+  size_t mem_limit_;
+  MemoryBalloon balloon_;
+  DiskIo disk_io_;
+  Engine engine_;
+  size_t chunk_size_;
+  size_t engine_depth_;
+  std::atomic<bool> fixed_buffers_;
+  Output output_;
+  Arguments arguments_;
+  std::vector<ThreadStats> thread_stats_;
+  long long interval_;
+  std::unique_ptr<LiveStats> live_;
+  long long warmup_time_;
+  size_t warmup_ops_;
+  double steady_cv_;
+  std::unique_ptr<SteadyState> steady_;
+  size_t total_warmup_ops_;
+  size_t total_warmup_bytes_;
+  long long total_warmup_time_;
+  bool warmup_steady_;
+  long long steady_time_;
+  double steady_cv_last_;
+  RunControl run_;
+  bool record_latency_;
+  std::vector<uint64_t> latency_counts_;
+  size_t rate_limit_;
+  IoPriority io_priority_;
+  std::string trace_path_;
+  std::chrono::steady_clock::time_point trace_start_;
+  Trace trace_;
+
+  // Slots for num_slots worker threads, the interval reporter, the steady
+  // state detector, which samples every interval or every 200 ms, and the
+  // watchdog. Without warm-up max_time starts now, otherwise the first
+  // worker to leave warm-up arms it.
+  void start_live(int num_slots) {
+    // The TSC is calibrated here, not on a worker's first op, where its
+    // 10 ms would land in that op's latency
+    TscTimer::ns_per_tick();
+    run_.start();
+    if (!has_warmup()) run_.arm(max_time_);
+    live_.reset(new LiveStats(num_slots));
+    live_->start(interval_, output_ == Output::TEXT ? &std::cout : &std::cerr,
+                 proc_ >= 0 ? "proc: " + std::to_string(proc_) + ", " : "");
+    steady_.reset();
+    if (steady_cv_ > 0.0) {
+      steady_.reset(new SteadyState(live_.get(), steady_cv_,
+                                    interval_ > 0 ? interval_ : 200000000LL));
+      steady_->start();
+    }
+  }
+
+  void stop_live() {
+    run_.finish();
+    live_->stop();
+    latency_counts_.assign(LatencyBuckets::NUM_BUCKETS, 0);
+    live_->latency_counts(latency_counts_.data());
+    if (!steady_) return;
+    steady_->stop();
+    steady_time_ = steady_->steady_time();
+    steady_cv_last_ = steady_->cv();
+  }
+
+  // Balloon, page cache state and residency around the run, only once in
+  // the parent when it is split over processes. The I/O snapshots leave
+  // out preparing the cache, workers are reaped before the second.
+  void begin_cache() {
+    if (proc_ >= 0) return;
+    if (mem_limit_ > 0) balloon_.inflate(mem_limit_);
+    prepare_cache(dir_fds_, file_dirs_, files_, cache_mode_);
+    cache_before_ = cache_residency(dir_fds_, file_dirs_, files_, file_sizes_);
+    disk_io_.begin();
+  }
+
+  void end_cache() {
+    if (proc_ >= 0) return;
+    disk_io_.end();
+    cache_after_ = cache_residency(dir_fds_, file_dirs_, files_, file_sizes_);
+    balloon_.deflate();
+  }
+
+  // Workers append their TraceLog to trace_ when done, it is written once
+  // the run is over. Records live in memory, so a trace is only taken with
+  // a single process.
+  void begin_trace() {
+    if (trace_path_.empty()) return;
+    if (procs_ > 1)
+      throw IOException("A trace is recorded by a single process, it cannot "
+                        "be combined with procs");
+    trace_.records.clear();
+    trace_start_ = std::chrono::steady_clock::now();
+  }
+
+  void end_trace() {
+    if (trace_path_.empty()) return;
+    trace_.dirs = dirs_;
+    trace_.files = files_;
+    trace_.file_dirs = file_dirs_;
+    trace_.file_sizes = file_sizes_;
+    trace_.write(trace_path_);
+    trace_.records.clear();
+  }
+
+  TraceLog make_trace_log(int thread) const {
+    return TraceLog(!trace_path_.empty(), trace_start_, thread);
+  }
+
+  void add_trace(std::vector<TraceRecord> &records) {
+    if (records.empty()) return;
+    const std::lock_guard<std::mutex> lock(mtx_);
+    trace_.records.insert(trace_.records.end(), records.begin(),
+                          records.end());
+  }
+
+  // Directory fd and path of file i
+  int file_dir_fd(size_t i) const { return dir_fds_[file_dirs_[i]]; }
+  std::string file_path(size_t i) const {
+    return dirs_[file_dirs_[i]] + "/" + files_[i];
+  }
+
+  // Files a worker picks from, [*begin, *begin + *count). With PER_DIR
+  // workers across all processes are dealt to the directories in turn.
+  void worker_files(int thread, size_t *begin, size_t *count) const {
+    if (placement_ == Placement::GLOBAL) {
+      *begin = 0;
+      *count = files_.size();
+      return;
+    }
+    size_t d = static_cast<size_t>(thread_base_ + thread) % dirs_.size();
+    *begin = dir_begin_[d];
+    *count = dir_begin_[d + 1] - dir_begin_[d];
+  }
+
+  void add_dir_bytes(const std::vector<size_t> &bytes) {
+    const std::lock_guard<std::mutex> lock(mtx_);
+    for (size_t d = 0; d < dir_bytes_.size(); d++) dir_bytes_[d] += bytes[d];
+  }
+
+  void print_dir_arguments() {
+    if (dirs_.size() > 1)
+      print_argument("placement", placement_name(placement_));
+  }
+
+  // Worker threads of all processes
+  int num_workers() const { return procs_ * num_threads_; }
+
+  // Warm-up of one of the workers, the ops are split between them
+  WarmupWindow make_warmup() const {
+    long long time = warmup_time_;
+    if (steady_cv_ > 0.0 && time == 0 && warmup_ops_ == 0) time = max_time_;
+    size_t ops = (warmup_ops_ + num_threads_ - 1) / num_threads_;
+    return WarmupWindow(time, ops, steady_ ? steady_->flag() : nullptr);
+  }
+
+  // Pacer of one worker, off without a rate limit
+  RatePacer make_pacer() const {
+    return RatePacer(rate_limit_ == 0
+                         ? 0.0
+                         : static_cast<double>(rate_limit_) / num_workers());
+  }
+
+  void print_class_arguments() {
+    if (rate_limit_ > 0) print_argument("rate", rate_limit_);
+    if (io_priority_.on())
+      print_argument("ioprio", io_priority_name(io_priority_));
+  }
+
+  void print_warmup_arguments() {
+    if (warmup_time_ > 0)
+      print_argument("warmup", std::to_string(warmup_time_));
+    else if (warmup_ops_ > 0)
+      print_argument("warmup", std::to_string(warmup_ops_) + "ops");
+    if (steady_cv_ > 0.0) print_argument("steady", std::to_string(steady_cv_));
+  }
+
+  void record_warmup(size_t ops, size_t bytes, long long time,
+                     bool by_steady) {
+    const std::lock_guard<std::mutex> lock(mtx_);
+    if (by_steady) warmup_steady_ = true;
+    total_warmup_ops_ += ops;
+    total_warmup_bytes_ += bytes;
+    if (time > total_warmup_time_) total_warmup_time_ = time;
+  }
+
+  // Caller holds mtx_
+  void record_thread(const ThreadStats &stats) {
+    size_t idx = static_cast<size_t>(thread_base_ + stats.thread);
+    if (idx >= thread_stats_.size()) thread_stats_.resize(idx + 1);
+    thread_stats_[idx] = stats;
+    thread_stats_[idx].thread = static_cast<int>(idx);
+  }
+
+  // Results of one worker process, written to shared memory by the child
+  // and merged by the parent
+  struct ProcTotals {
+    size_t ops;
+    size_t records;
+    size_t bytes;
+    long long time;
+    CpuUsage usage;
+    PerfCounts perf;
+    size_t warmup_ops;
+    size_t warmup_bytes;
+    long long warmup_time;
+    bool warmup_steady;
+    long long steady_time;
+    double steady_cv;
+    bool fixed_buffers;
+  };
+
+  // Fields of subclasses that also cross the process boundary, they must
+  // be trivially copyable
+  virtual size_t proc_extra_size() const { return 0; }
+  virtual void save_proc_extra(char *) const {}
+  virtual void merge_proc_extra(const char *) {}
+
+  // Fork procs_ children that each run start_read() with their own threads
+  // once all of them are ready, and merge their results. Interval reports
+  // and steady state detection stay per process.
+  void run_procs() {
+    size_t extra_off = align_ceil(sizeof(ProcTotals), 64);
+    size_t threads_off = extra_off + align_ceil(proc_extra_size() + 1, 64);
+    size_t dirs_off =
+        threads_off + align_ceil(num_threads_ * sizeof(ThreadStats), 64);
+    size_t latency_off =
+        dirs_off + align_ceil(dirs_.size() * sizeof(size_t), 64);
+    size_t stride =
+        latency_off + LatencyBuckets::NUM_BUCKETS * sizeof(uint64_t);
+    size_t header = 64;
+    size_t len = header + stride * procs_;
+    void *mem = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+      throw IOException("Failed to map the process stats, error " +
+                        std::to_string(errno));
+    char *base = static_cast<char *>(mem);
+    std::atomic<int> *ready = new (base) std::atomic<int>(0);
+    std::atomic<bool> *go = new (base + sizeof(std::atomic<int>))
+        std::atomic<bool>(false);
+
+    // Nothing buffered may be printed twice
+    std::cout.flush();
+    std::cerr.flush();
+    std::vector<pid_t> pids;
+    for (int p = 0; p < procs_; p++) {
+      pid_t pid = fork();
+      if (pid == -1) {
+        int err = errno;
+        for (pid_t c : pids) kill(c, SIGKILL);
+        for (pid_t c : pids) waitpid(c, nullptr, 0);
+        munmap(mem, len);
+        throw IOException("Failed to fork, error " + std::to_string(err));
+      }
+      if (pid == 0) {
+        char *slot = base + header + stride * p;
+        int status = 0;
+        procs_ = 1;
+        proc_ = p;
+        thread_base_ = p * num_threads_;
+        ready->fetch_add(1);
+        while (!go->load()) sched_yield();
+        try {
+          start_read();
+          ProcTotals *totals = reinterpret_cast<ProcTotals *>(slot);
+          totals->ops = total_ops_;
+          totals->records = total_records_;
+          totals->bytes = total_bytes_;
+          totals->time = total_time_;
+          totals->usage = total_usage_;
+          totals->perf = total_perf_;
+          totals->warmup_ops = total_warmup_ops_;
+          totals->warmup_bytes = total_warmup_bytes_;
+          totals->warmup_time = total_warmup_time_;
+          totals->warmup_steady = warmup_steady_;
+          totals->steady_time = steady_time_;
+          totals->steady_cv = steady_cv_last_;
+          totals->fixed_buffers = fixed_buffers_;
+          save_proc_extra(slot + extra_off);
+          ThreadStats *threads =
+              reinterpret_cast<ThreadStats *>(slot + threads_off);
+          for (int t = 0; t < num_threads_; t++)
+            threads[t] = thread_stats_[thread_base_ + t];
+          memcpy(slot + dirs_off, dir_bytes_.data(),
+                 dir_bytes_.size() * sizeof(size_t));
+          memcpy(slot + latency_off, latency_counts_.data(),
+                 latency_counts_.size() * sizeof(uint64_t));
+        } catch (const std::exception &e) {
+          std::cerr << e.what() << std::endl;
+          status = 1;
+        }
+        std::cout.flush();
+        std::cerr.flush();
+        _exit(status);
+      }
+      pids.push_back(pid);
+    }
+
+    while (ready->load() < procs_) sched_yield();
+    go->store(true);
+    int failed = 0;
+    for (pid_t pid : pids) {
+      int status;
+      if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) ||
+          WEXITSTATUS(status) != 0)
+        failed++;
+    }
+    if (failed > 0) {
+      munmap(mem, len);
+      throw IOException(std::to_string(failed) + " of " +
+                        std::to_string(procs_) + " worker processes failed");
+    }
+
+    latency_counts_.assign(LatencyBuckets::NUM_BUCKETS, 0);
+    for (int p = 0; p < procs_; p++) {
+      const char *slot = base + header + stride * p;
+      const ProcTotals *totals = reinterpret_cast<const ProcTotals *>(slot);
+      total_ops_ += totals->ops;
+      total_records_ += totals->records;
+      total_bytes_ += totals->bytes;
+      if (totals->time > total_time_) total_time_ = totals->time;
+      total_usage_ += totals->usage;
+      total_perf_ += totals->perf;
+      total_warmup_ops_ += totals->warmup_ops;
+      total_warmup_bytes_ += totals->warmup_bytes;
+      if (totals->warmup_time > total_warmup_time_)
+        total_warmup_time_ = totals->warmup_time;
+      if (totals->warmup_steady) warmup_steady_ = true;
+      steady_time_ = std::max(steady_time_, totals->steady_time);
+      steady_cv_last_ = std::max(steady_cv_last_, totals->steady_cv);
+      if (!totals->fixed_buffers) fixed_buffers_ = false;
+      merge_proc_extra(slot + extra_off);
+      const ThreadStats *threads =
+          reinterpret_cast<const ThreadStats *>(slot + threads_off);
+      for (int t = 0; t < num_threads_; t++) record_thread(threads[t]);
+      const size_t *dir_bytes =
+          reinterpret_cast<const size_t *>(slot + dirs_off);
+      for (size_t d = 0; d < dir_bytes_.size(); d++)
+        dir_bytes_[d] += dir_bytes[d];
+      const uint64_t *latency =
+          reinterpret_cast<const uint64_t *>(slot + latency_off);
+      for (int b = 0; b < LatencyBuckets::NUM_BUCKETS; b++)
+        latency_counts_[b] += latency[b];
+    }
+    munmap(mem, len);
+  }
+
+  EngineConfig engine_config(size_t chunk_size, size_t max_targets,
+                             bool own_buffer) const {
+    EngineConfig config;
+    config.chunk_size = chunk_size;
+    config.record_size =
+        buffered_ ? record_size_ : align_buf(record_size_, block_size_);
+    config.max_targets = max_targets;
+    config.depth = engine_depth_;
+    config.io_align = buffered_ ? 0 : block_size_;
+    config.buffered = buffered_;
+    config.own_buffer = own_buffer;
+    config.huge_pages = huge_pages_;
+    config.mem_align = buffered_ ? 0 : dio_mem_align_;
+    return config;
+  }
+
+  void update_usage(const CpuUsage &usage, const PerfCounts &perf) {
+    const std::lock_guard<std::mutex> lock(mtx_);
+    total_usage_ += usage;
+    total_perf_ += perf;
+  }
 };
 
 }  // namespace tps
@@ -0,0 +1,246 @@
+#include "file_replay.hpp"
+
+#include <algorithm>
+#include <thread>
+
+#include "perf_counter.hpp"
+
+namespace tps {
+
+// A max_time of 0 replays to the end of the trace
+static const long long REPLAY_UNTIL_END = 365LL * 24 * 3600 * 1000000000LL;
+
+FileReplay::FileReplay(std::shared_ptr<const Trace> trace,
+                       const std::string &dir_list, size_t record_size,
+                       long long max_time, bool buffered, int num_threads)
+    : FileRead(trace->file_list(dir_list), record_size,
+               max_time > 0 ? max_time : REPLAY_UNTIL_END, buffered,
+               num_threads),
+      trace_(trace),
+      timing_(ReplayTiming::FAST),
+      next_(0),
+      total_issued_(0),
+      latency_(LatencyBuckets::NUM_BUCKETS, 0),
+      lag_(LatencyBuckets::NUM_BUCKETS, 0),
+      max_latency_(0),
+      max_lag_(0) {}
+
+void FileReplay::start_read() {
+  begin_cache();
+  run_threads();
+  end_cache();
+}
+
+void FileReplay::run_threads() {
+  start_live(num_threads_);
+  next_.store(0);
+  replay_start_ = std::chrono::steady_clock::now();
+
+  std::vector<std::thread> threads;
+  threads.reserve(num_threads_);
+  for (int i = 0; i < num_threads_; i++)
+    threads.emplace_back(&FileReplay::do_read, this, i);
+  for (int i = 0; i < num_threads_; i++) threads[i].join();
+  stop_live();
+}
+
+void FileReplay::do_read(int thread) {
+  switch (engine_) {
+    case Engine::PREAD:
+      do_read_with<PreadEngine>(thread);
+      break;
+    case Engine::PREADV:
+      do_read_with<PreadvEngine>(thread);
+      break;
+    case Engine::MMAP:
+      do_read_with<MmapEngine>(thread);
+      break;
+    case Engine::SPLICE:
+      do_read_with<SpliceEngine>(thread);
+      break;
+    case Engine::SENDFILE:
+      do_read_with<SendfileEngine>(thread);
+      break;
+    case Engine::URING:
+      do_read_with<UringEngine>(thread);
+      break;
+    default:
+      do_read_with<ReadEngine>(thread);
+      break;
+  }
+}
+
+template <class IoEngine>
+void FileReplay::do_read_with(int thread) {
+  typedef std::chrono::steady_clock Clock;
+  size_t local_ops = 0;
+  size_t local_bytes = 0;
+  std::vector<size_t> local_dir_bytes(dirs_.size(), 0);
+  std::vector<uint64_t> latency(LatencyBuckets::NUM_BUCKETS, 0);
+  std::vector<uint64_t> lag(LatencyBuckets::NUM_BUCKETS, 0);
+  uint64_t max_latency = 0;
+  uint64_t max_lag = 0;
+
+  size_t blk_size = block_size_;
+  size_t buf_size =
+      buffered_ ? record_size_ : align_buf(record_size_, blk_size);
+  IoEngine engine(engine_config(buf_size, 1, true));
+  LiveCounter live(live_->slot(thread));
+  if (!engine.fixed_buffers()) fixed_buffers_ = false;
+
+  CpuUsage usage_start = CpuUsage::thread();
+  PerfGroup perf(counters_);
+  perf.start();
+
+  const std::vector<TraceRecord> &records = trace_->records;
+  bool timed = timing_ == ReplayTiming::ORIGINAL;
+  Clock::time_point start = replay_start_;
+  Clock::time_point last = start;
+  while (!run_.stopped()) {
+    size_t i = next_.fetch_add(1, std::memory_order_relaxed);
+    if (i >= records.size()) break;
+    const TraceRecord &r = records[i];
+
+    Clock::time_point due = start + std::chrono::nanoseconds(r.time_ns);
+    // Sleeps overshoot by tens of us, the last stretch is spun
+    if (timed && Clock::now() < due) {
+      Clock::time_point wake = due - std::chrono::microseconds(100);
+      if (Clock::now() < wake) std::this_thread::sleep_until(wake);
+      while (Clock::now() < due) {
+      }
+    }
+    Clock::time_point issue = Clock::now();
+    if (timed) {
+      uint64_t behind = std::max<long long>(
+          0, std::chrono::duration_cast<std::chrono::nanoseconds>(issue - due)
+                 .count());
+      lag[LatencyBuckets::index(behind)]++;
+      max_lag = std::max(max_lag, behind);
+    }
+
+    // Direct I/O widens the range to whole blocks, a trace taken through
+    // the page cache need not be aligned
+    size_t fidx = r.file;
+    size_t fsize = file_sizes_[fidx];
+    size_t pos = std::min<size_t>(r.offset, fsize);
+    size_t len = std::min<size_t>(r.length, fsize - pos);
+    if (!buffered_) {
+      size_t end = std::min(fsize, align_ceil(pos + len, blk_size));
+      pos = align_floor(pos, blk_size);
+      len = end - pos;
+    }
+
+    int t;
+    if ((t = engine.open(file_dir_fd(fidx), files_[fidx].c_str(), fsize)) ==
+        -1)
+      throw IOException("Failed to open " + file_path(fidx) + ", error " +
+                        std::to_string(errno));
+    if (!engine.submit(t, pos, len))
+      throw IOException("Failed to seek " + file_path(fidx) + ", error " +
+                        std::to_string(errno));
+    size_t bytes = 0;
+    while (len > 0) {
+      const char *data;
+      size_t bytes_read = engine.reap(t, nullptr, &data);
+      if (bytes_read == IO_ERROR)
+        throw IOException("Failed to read " + file_path(fidx) + ", error " +
+                          std::to_string(errno));
+      if (bytes_read == 0) break;
+      // Only the recorded range counts, whatever the chunk size
+      size_t n = std::min(len, bytes_read);
+      len -= n;
+      bytes += n;
+    }
+    engine.close(t);
+
+    last = Clock::now();
+    uint64_t took =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(last - issue)
+            .count();
+    latency[LatencyBuckets::index(took)]++;
+    max_latency = std::max(max_latency, took);
+    local_ops++;
+    local_bytes += bytes;
+    local_dir_bytes[file_dirs_[fidx]] += bytes;
+    live.add_bytes(bytes);
+    live.add_op(took);
+  }
+  perf.stop();
+  CpuUsage usage = CpuUsage::thread() - usage_start;
+
+  long long time =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(last - start)
+          .count();
+  update_stats(thread, time, local_ops, local_bytes, latency, lag,
+               max_latency, max_lag);
+  add_dir_bytes(local_dir_bytes);
+  update_usage(usage, perf.counts());
+}
+
+void FileReplay::update_stats(int thread, long long time, size_t ops,
+                              size_t bytes,
+                              const std::vector<uint64_t> &latency,
+                              const std::vector<uint64_t> &lag,
+                              uint64_t max_latency, uint64_t max_lag) {
+  const std::lock_guard<std::mutex> lock(mtx_);
+  record_thread({thread, ops, bytes, ops, ops, time});
+  if (time > total_time_) total_time_ = time;
+  total_ops_ += ops;
+  total_records_ += ops;
+  total_bytes_ += bytes;
+  total_issued_ += ops;
+  for (int b = 0; b < LatencyBuckets::NUM_BUCKETS; b++) {
+    latency_[b] += latency[b];
+    lag_[b] += lag[b];
+  }
+  max_latency_ = std::max(max_latency_, max_latency);
+  max_lag_ = std::max(max_lag_, max_lag);
+}
+
+void FileReplay::print_replay(std::ostream &os) const {
+  os << "replayed: " << total_issued_ << " of " << trace_records()
+     << " records, trace time: " << trace_time() << " ns" << std::endl;
+  os << "latency: p50: " << latency(0.5) << " ns, p99: " << latency(0.99)
+     << " ns, p99.9: " << latency(0.999) << " ns, max: " << max_latency_
+     << " ns" << std::endl;
+  if (timing_ != ReplayTiming::ORIGINAL) return;
+  os << "lag: p50: " << lag(0.5) << " ns, p99: " << lag(0.99)
+     << " ns, p99.9: " << lag(0.999) << " ns, max: " << max_lag_ << " ns"
+     << std::endl;
+}
+
+void FileReplay::add_replay_results(Report *report) const {
+  report->add_result("records_replayed", total_issued_);
+  report->add_result("trace_records", trace_records());
+  report->add_result("trace_time_ns", trace_time());
+  report->add_result("latency_p50_ns", latency(0.5));
+  report->add_result("latency_p99_ns", latency(0.99));
+  report->add_result("latency_p999_ns", latency(0.999));
+  report->add_result("latency_max_ns", max_latency_);
+  if (timing_ != ReplayTiming::ORIGINAL) return;
+  report->add_result("lag_p50_ns", lag(0.5));
+  report->add_result("lag_p99_ns", lag(0.99));
+  report->add_result("lag_p999_ns", lag(0.999));
+  report->add_result("lag_max_ns", max_lag_);
+}
+
+void FileReplay::print_arguments() {
+  arguments_.clear();
+  print_argument("page-size", get_page_size());
+  print_argument("block-size", block_size_);
+  print_argument("dir", dir_);
+  print_argument("record-size", record_size_);
+  long long max_time = max_time_ == REPLAY_UNTIL_END ? 0 : max_time_;
+  print_argument("max-time", std::to_string(max_time));
+  print_argument("buffered", buffered_);
+  print_argument("threads", std::to_string(num_threads_));
+  print_argument("hugepages", huge_pages_name(huge_pages_));
+  print_argument("engine", engine_name(engine_));
+  print_argument("timing", replay_timing_name(timing_));
+  if (counters_) print_argument("counters", counters_);
+  if (cache_mode_ != CacheMode::AS_IS)
+    print_argument("cache", cache_mode_name(cache_mode_));
+  if (mem_limit_ > 0) print_argument("mem-limit", mem_limit_);
+}
+
+}  // namespace tps
@@ -0,0 +1,92 @@
+#ifndef FILE_REPLAY_HPP
+#define FILE_REPLAY_HPP
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "file_read.hpp"
+#include "helper.hpp"
+#include "live_stats.hpp"
+#include "report.hpp"
+#include "trace.hpp"
+
+namespace tps {
+
+// FAST issues every record as soon as a thread is free, ORIGINAL not before
+// its recorded time, so a slower setup falls behind the trace
+enum class ReplayTiming { FAST, ORIGINAL };
+
+static bool parse_replay_timing(const std::string &str, ReplayTiming *timing) {
+  std::string value = to_lower(str);
+  if (value.compare("fast") == 0)
+    *timing = ReplayTiming::FAST;
+  else if (value.compare("original") == 0)
+    *timing = ReplayTiming::ORIGINAL;
+  else
+    return false;
+  return true;
+}
+
+static std::string replay_timing_name(ReplayTiming timing) {
+  return timing == ReplayTiming::ORIGINAL ? "original" : "fast";
+}
+
+// Re-issues the reads of a trace on threads that take the records in trace
+// order from a shared cursor. Records are read in chunks of record_size.
+class FileReplay : public FileRead {
+ public:
+  // dir_list replaces the recorded directories when not empty
+  FileReplay(std::shared_ptr<const Trace> trace, const std::string &dir_list,
+             size_t record_size, long long max_time, bool buffered,
+             int num_threads);
+
+  void set_timing(ReplayTiming timing) { timing_ = timing; }
+
+  void start_read();
+
+  void print_arguments();
+
+  // Records issued, how far behind their recorded time they were issued and
+  // how long they took
+  size_t total_records_issued() const { return total_issued_; }
+  size_t trace_records() const { return trace_->records.size(); }
+  long long trace_time() const { return trace_->duration(); }
+  uint64_t latency(double p) const {
+    return LatencyBuckets::percentile(latency_.data(), p);
+  }
+  uint64_t lag(double p) const {
+    return LatencyBuckets::percentile(lag_.data(), p);
+  }
+  uint64_t max_latency() const { return max_latency_; }
+  uint64_t max_lag() const { return max_lag_; }
+
+  void print_replay(std::ostream &os) const;
+  void add_replay_results(Report *report) const;
+
+ private:
+  void run_threads();
+  void do_read(int thread);
+  template <class IoEngine>
+  void do_read_with(int thread);
+  void update_stats(int thread, long long time, size_t ops, size_t bytes,
+                    const std::vector<uint64_t> &latency,
+                    const std::vector<uint64_t> &lag, uint64_t max_latency,
+                    uint64_t max_lag);
+
+  std::shared_ptr<const Trace> trace_;
+  ReplayTiming timing_;
+  std::atomic<size_t> next_;
+  std::chrono::steady_clock::time_point replay_start_;
+  size_t total_issued_;
+  std::vector<uint64_t> latency_;
+  std::vector<uint64_t> lag_;
+  uint64_t max_latency_;
+  uint64_t max_lag_;
+};
+
+}  // namespace tps
+
+#endif  // FILE_REPLAY_HPP
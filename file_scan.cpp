@@ -1,15 +1,14 @@
 #include "file_scan.hpp"
 
-#include <fcntl.h>
-
 #include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <random>
 #include <thread>
-#include <unordered_map>
-#include <unordered_set>
+#include <type_traits>
 #include <vector>
 
+#include "perf_counter.hpp"
 #include "timer.hpp"
 
 namespace tps {
@@ -19,12 +18,32 @@ FileScan::FileScan(const std::string dir_path, size_t record_size,
                    const Bounds &ex_bounds, const Bounds &in_bounds,
                    bool sequential_files, bool sequential_scan,
                    bool full_middle)
-    : FileRead(dir_path, record_size, max_time, buffered, num_threads),
+    : FileScan(FileList::load(dir_path), record_size, max_time, buffered,
+               num_threads, ex_bounds, in_bounds, sequential_files,
+               sequential_scan, full_middle) {}
+
+FileScan::FileScan(std::shared_ptr<const FileList> list, size_t record_size,
+                   long long max_time, bool buffered, int num_threads,
+                   const Bounds &ex_bounds, const Bounds &in_bounds,
+                   bool sequential_files, bool sequential_scan,
+                   bool full_middle)
+    : FileRead(list, record_size, max_time, buffered, num_threads),
       seq_file_(sequential_files),
       seq_scan_(sequential_scan),
       full_middle_(full_middle),
       full_scan_(false),
-      total_files_(0) {
+      total_files_(0),
+      compute_(Compute::NONE, 8, 0.5, Compute::AUTO),
+      total_io_time_(0),
+      total_compute_time_(0),
+      pipeline_(false),
+      num_consumers_(0),
+      ring_depth_(0),
+      ring_buf_size_(0),
+      active_readers_(0),
+      total_buffers_(0),
+      total_reader_stall_(0),
+      total_consumer_stall_(0) {
   if (files_.size() == 1) {
     min_files_ = 1;
     max_files_ = 1;
@@ -80,8 +99,27 @@ FileScan::FileScan(const std::string dir_path, size_t record_size,
 }
 
 void FileScan::start_read() {
+  begin_cache();
+  begin_trace();
+  if (procs_ > 1)
+    run_procs();
+  else
+    run_threads();
+  end_trace();
+  end_cache();
+}
+
+void FileScan::run_threads() {
+  start_live(num_threads_);
+  if (pipeline_) {
+    start_pipeline();
+    stop_live();
+    return;
+  }
+
   if (num_threads_ < 2) {
-    do_read();
+    do_read(0);
+    stop_live();
     return;
   }
 
@@ -89,9 +127,53 @@ void FileScan::start_read() {
   threads.reserve(num_threads_);
 
   for (int i = 0; i < num_threads_; i++)
-    threads.emplace_back(&FileScan::do_read, this);
+    threads.emplace_back(&FileScan::do_read, this, i);
 
   for (int i = 0; i < num_threads_; i++) threads[i].join();
+  stop_live();
+}
+
+void FileScan::set_pipeline(int num_consumers, size_t ring_depth,
+                            size_t buffer_size) {
+  pipeline_ = true;
+  num_consumers_ = std::max(1, num_consumers);
+  ring_depth_ = std::max<size_t>(1, ring_depth);
+  ring_buf_size_ = buffer_size == 0 ? record_size_ : buffer_size;
+}
+
+void FileScan::start_pipeline() {
+  size_t blk_size = block_size_;
+  if (!buffered_) ring_buf_size_ = align_buf(ring_buf_size_, blk_size);
+
+  free_ring_.reset(new RingQueue<size_t>(ring_depth_));
+  full_ring_.reset(new RingQueue<size_t>(ring_depth_));
+  ring_bufs_.assign(ring_depth_, nullptr);
+  ring_lens_.assign(ring_depth_, 0);
+  for (size_t i = 0; i < ring_depth_; i++) {
+    ring_bufs_[i] = alloc_buffer(ring_buf_size_, huge_pages_,
+                                 buffered_ ? 0 : dio_mem_align_);
+    free_ring_->push(i);
+  }
+  active_readers_.store(num_threads_);
+
+  std::vector<std::thread> threads;
+  threads.reserve(num_threads_ + num_consumers_);
+
+  for (int i = 0; i < num_consumers_; i++)
+    threads.emplace_back(&FileScan::do_consume, this);
+  for (int i = 0; i < num_threads_; i++)
+    threads.emplace_back(&FileScan::do_read, this, i);
+
+  for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+
+  for (char *ptr : ring_bufs_)
+    free_buffer(ptr, ring_buf_size_, huge_pages_);
+  ring_bufs_.clear();
+}
+
+void FileScan::set_compute(const Compute &compute) {
+  compute_ = Compute(compute.kernel(), compute.column_width(),
+                     compute.selectivity(), compute.isa());
 }
 
 void FileScan::rand_read_info(size_t *pos, size_t *read_size, size_t file_size,
@@ -111,46 +193,189 @@ void FileScan::rand_read_info(size_t *pos, size_t *read_size, size_t file_size,
   *read_size = s;
 }
 
-void FileScan::do_read() {
+void FileScan::do_read(int thread) {
+  apply_io_priority(io_priority_);
+  switch (engine_) {
+    case Engine::PREAD:
+      do_read_with<PreadEngine>(thread);
+      break;
+    case Engine::PREADV:
+      do_read_with<PreadvEngine>(thread);
+      break;
+    case Engine::MMAP:
+      do_read_with<MmapEngine>(thread);
+      break;
+    case Engine::SPLICE:
+      do_read_with<SpliceEngine>(thread);
+      break;
+    case Engine::SENDFILE:
+      do_read_with<SendfileEngine>(thread);
+      break;
+    case Engine::URING:
+      do_read_with<UringEngine>(thread);
+      break;
+    default:
+      do_read_with<ReadEngine>(thread);
+      break;
+  }
+}
+
+template <class IoEngine>
+void FileScan::do_read_with(int thread) {
   size_t local_ops = 0;
   size_t local_bytes = 0;
   size_t local_files = 0;
 
   std::random_device rd;
   std::mt19937 gen(rd());
-  std::uniform_int_distribution<size_t> file_dist(min_files_, max_files_);
+  // Files this worker picks from, [first_file, first_file + num_files)
+  size_t first_file, num_files;
+  worker_files(thread, &first_file, &num_files);
+  size_t min_files = std::min(min_files_, num_files);
+  size_t max_files = std::min(max_files_, num_files);
+  std::uniform_int_distribution<size_t> file_dist(min_files, max_files);
   std::uniform_real_distribution<double> ratio_dist(size_bounds_.min_size,
                                                     size_bounds_.max_ratio);
   std::uniform_int_distribution<size_t> size_dist(size_bounds_.min_size,
                                                   size_bounds_.max_size);
   std::uniform_real_distribution<double> pos_dist(0.0, 1.0);
 
-  size_t blk_size = get_block_size();
+  size_t blk_size = block_size_;
   size_t buf_size =
       buffered_ ? record_size_ : align_buf(record_size_, blk_size);
-  char *buf = new char[buf_size];
+  if (pipeline_) buf_size = ring_buf_size_;
+  if (!pipeline_ && chunk_size_ > 0) {
+    buf_size = chunk_size_;
+    if (!buffered_) buf_size = align_buf(buf_size, blk_size);
+  }
   size_t align_size = buffered_ ? record_size_ : blk_size;
 
-  int flags = O_RDONLY;
-  if (!buffered_) flags |= O_DIRECT;
+  // Interleaved scans keep every picked file open at once
+  size_t max_targets = seq_scan_ || num_files == 1 ? 1 : max_files;
+  IoEngine engine(engine_config(buf_size, max_targets, !pipeline_));
+  if (!engine.fixed_buffers()) fixed_buffers_ = false;
+
+  Compute compute(compute_.kernel(), compute_.column_width(),
+                  compute_.selectivity(), compute_.isa());
+  bool computing = compute.kernel() != Compute::NONE;
+  long long local_compute = 0;
+  TscTimer ctimer;
+  long long local_stall = 0;
+  TscTimer stimer;
+  // A scan is paced per chunk, its latency includes the time held back
+  RatePacer pacer = make_pacer();
+
+  // Read the next chunk of target t. In pipeline mode the chunk goes into a
+  // free ring buffer which is then handed to the consumer threads.
+  auto read_next = [&](int t) -> size_t {
+    const char *data;
+    if (!pipeline_) {
+      size_t bytes_read = engine.reap(t, nullptr, &data);
+      if (computing && bytes_read != IO_ERROR && bytes_read > 0) {
+        ctimer.start();
+        compute.consume(data, bytes_read);
+        ctimer.stop();
+        local_compute += ctimer.elapsed_ns();
+      }
+      if (pacer.on() && bytes_read != IO_ERROR) pacer.pay(bytes_read, run_);
+      return bytes_read;
+    }
 
-  bool running = true;
+    size_t slot;
+    if (!free_ring_->pop(&slot)) {
+      stimer.start();
+      while (!free_ring_->pop(&slot)) std::this_thread::yield();
+      stimer.stop();
+      local_stall += stimer.elapsed_ns();
+    }
+    size_t bytes_read = engine.reap(t, ring_bufs_[slot], &data);
+    if (bytes_read == IO_ERROR || bytes_read == 0) {
+      free_ring_->push(slot);
+    } else {
+      ring_lens_[slot] = bytes_read;
+      full_ring_->push(slot);
+      pacer.pay(bytes_read, run_);
+    }
+    return bytes_read;
+  };
+
+  // Per-operation state is sized once so that the loop never allocates.
+  // marks[f] == epoch tells that file f is already picked in this operation.
+  size_t max_picks = std::max<size_t>(1, max_files);
+  std::vector<size_t> picks;
+  picks.reserve(max_picks);
+  std::vector<size_t> positions(max_picks);
+  std::vector<size_t> lengths(max_picks);
+  std::vector<int> targets(max_picks);
+  std::vector<size_t> active(max_picks);
+  std::vector<uint32_t> marks(num_files, 0);
+  uint32_t epoch = 0;
+  std::vector<size_t> local_dir_bytes(dirs_.size(), 0);
+  std::vector<size_t> warm_dir_bytes(dirs_.size(), 0);
 
-  HighResTimer timer;
+  bool running = true;
+  LiveCounter live(live_->slot(thread));
+  TraceLog trace = make_trace_log(thread);
+  long long op_start = 0;
+
+  CpuUsage usage_start = CpuUsage::thread();
+  PerfGroup perf(counters_);
+  perf.start();
+
+  // Counts at the end of warm-up, the results start from there and the
+  // run ends max_time later when the watchdog sets the stop flag
+  WarmupWindow warmup = make_warmup();
+  size_t warm_ops = 0;
+  size_t warm_bytes = 0;
+  size_t warm_files = 0;
+  long long warm_time = 0;
+  long long warm_compute = 0;
+  long long warm_stall = 0;
+
+  // The clock is read per op only for latencies and warm-up
+  bool latencies = has_latency();
+  TscTimer timer;
+  // Count the operation, publish its latency and check for the end of
+  // warm-up
+  auto end_op = [&]() {
+    local_ops++;
+    if (!latencies && !warmup.active()) {
+      live.add_op(0);
+      return;
+    }
+    timer.stop();
+    long long op_end = timer.elapsed_ns();
+    live.add_op(op_end - op_start);
+    op_start = op_end;
+    if (warmup.active() && warmup.end(local_ops, op_end)) {
+      warm_ops = local_ops;
+      warm_bytes = local_bytes;
+      warm_files = local_files;
+      warm_time = op_end;
+      warm_compute = local_compute;
+      warm_stall = local_stall;
+      warm_dir_bytes = local_dir_bytes;
+      live.end_warmup();
+      usage_start = CpuUsage::thread();
+      perf.start();
+      run_.arm(max_time_);
+    }
+  };
   timer.start();
-  if (files_.size() == 1) {
-    std::string picked_file = dir_ + "/" + files_[0];
-    size_t fsize = file_sizes_[0];
+  if (num_files == 1) {
+    const char *picked_file = files_[first_file].c_str();
+    size_t fsize = file_sizes_[first_file];
+    int picked_dir_fd = file_dir_fd(first_file);
+    size_t &picked_dir_bytes = local_dir_bytes[file_dirs_[first_file]];
 
     while (running) {
-      int fd;
-      if ((fd = open(picked_file.c_str(), flags)) == -1) {
-        throw IOException("Failed to open " + picked_file + ", error " +
-                          std::to_string(errno));
+      int t;
+      if ((t = engine.open(picked_dir_fd, picked_file, fsize)) == -1) {
+        throw IOException("Failed to open " + file_path(first_file) +
+                          ", error " + std::to_string(errno));
       }
       local_files++;
-      timer.stop();
-      if (timer.elapsed_ns() >= max_time_) {
+      if (run_.stopped()) {
         running = false;
         break;
       }
@@ -179,61 +404,66 @@ void FileScan::do_read() {
       }
 
       if (running) {
-        if (pos > 0 && lseek(fd, pos, SEEK_SET) == -1) {
-          throw IOException("Failed to seek " + picked_file + ", error " +
-                            std::to_string(errno));
+        if (trace.on()) trace.add(TRACE_SCAN, first_file, pos, len);
+        if (!engine.submit(t, pos, len)) {
+          throw IOException("Failed to seek " + file_path(first_file) +
+                            ", error " + std::to_string(errno));
         }
-        timer.stop();
-        if (timer.elapsed_ns() >= max_time_) running = false;
+        if (run_.stopped()) running = false;
       }
 
       if (running) {
         size_t records_read =
             static_cast<size_t>(floor(1.0 * len / record_size_));
         while (running && len > 0) {
-          size_t bytes_read = read(fd, buf, buf_size);
+          size_t bytes_read = read_next(t);
           if (bytes_read == IO_ERROR) {
-            throw IOException("Failed to read " + picked_file + ", error " +
-                              std::to_string(errno));
+            throw IOException("Failed to read " + file_path(first_file) +
+                              ", error " + std::to_string(errno));
           }
-          len -= bytes_read;
+          len -= std::min(len, bytes_read);
           local_bytes += bytes_read;
+          picked_dir_bytes += bytes_read;
+          live.add_bytes(bytes_read);
 
-          timer.stop();
-          if (timer.elapsed_ns() >= max_time_) running = false;
+          if (run_.stopped()) running = false;
         }
       }
-      close(fd);
+      engine.close(t);
 
-      local_ops++;
+      end_op();
       if (running) {
-        timer.stop();
-        if (timer.elapsed_ns() >= max_time_) break;
+        if (run_.stopped()) break;
       }
     }
   } else {
     while (running) {
       size_t rand_num_files =
-          min_files_ == max_files_ ? min_files_ : file_dist(gen);
-
-      std::vector<size_t> rand_indexes;
-      std::unordered_set<size_t> uniques;
-      rand_indexes.reserve(rand_num_files);
+          min_files == max_files ? min_files : file_dist(gen);
 
-      while (uniques.size() < rand_num_files) {
-        size_t ridx = get_round(pos_dist(gen), 0, files_.size() - 1);
-        if (uniques.insert(ridx).second) rand_indexes.push_back(ridx);
+      // Floyd's sampling of rand_num_files unique files in as many draws
+      picks.clear();
+      if (++epoch == 0) {
+        std::fill(marks.begin(), marks.end(), 0);
+        epoch = 1;
+      }
+      for (size_t j = num_files - rand_num_files; j < num_files; j++) {
+        size_t t = std::uniform_int_distribution<size_t>(0, j)(gen);
+        size_t ridx = marks[t] == epoch ? j : t;
+        marks[ridx] = epoch;
+        picks.push_back(first_file + ridx);
       }
 
-      if (seq_file_) std::sort(rand_indexes.begin(), rand_indexes.end());
-      std::unordered_map<size_t, size_t> positions;
-      std::unordered_map<size_t, size_t> lengths;
+      if (seq_file_)
+        std::sort(picks.begin(), picks.end());
+      else
+        std::shuffle(picks.begin(), picks.end(), gen);
 
       size_t pos;
       size_t len;
 
       if (full_middle_) {
-        size_t fidx = rand_indexes[0];
+        size_t fidx = picks[0];
         if (size_bounds_.is_ratio) {
           size_t size_ratio = size_bounds_.min_ratio == size_bounds_.max_ratio
                                   ? size_bounds_.min_ratio
@@ -253,17 +483,17 @@ void FileScan::do_read() {
                               align_size);
           }
         }
-        positions.insert({fidx, file_sizes_[fidx] - len});
-        lengths.insert({fidx, len});
+        positions[0] = file_sizes_[fidx] - len;
+        lengths[0] = len;
 
         if (rand_num_files > 1) {
           for (size_t i = 1; i < rand_num_files - 1; i++) {
-            fidx = rand_indexes[i];
-            positions.insert({fidx, 0});
-            lengths.insert({fidx, file_sizes_[fidx]});
+            fidx = picks[i];
+            positions[i] = 0;
+            lengths[i] = file_sizes_[fidx];
           }
 
-          fidx = rand_indexes[rand_num_files - 1];
+          fidx = picks[rand_num_files - 1];
           if (size_bounds_.is_ratio) {
             size_t size_ratio = size_bounds_.min_ratio == size_bounds_.max_ratio
                                     ? size_bounds_.min_ratio
@@ -276,12 +506,12 @@ void FileScan::do_read() {
                                ? size_bounds_.min_size
                                : size_dist(gen));
           }
-          positions.insert({fidx, 0});
-          lengths.insert({fidx, len});
+          positions[rand_num_files - 1] = 0;
+          lengths[rand_num_files - 1] = len;
         }
       } else {
         for (size_t i = 0; i < rand_num_files; i++) {
-          size_t fidx = rand_indexes[i];
+          size_t fidx = picks[i];
 
           if (size_bounds_.is_ratio) {
             size_t size_ratio = size_bounds_.min_ratio == size_bounds_.max_ratio
@@ -303,151 +533,286 @@ void FileScan::do_read() {
             }
           }
 
-          positions.insert({fidx, pos});
-          lengths.insert({fidx, len});
+          positions[i] = pos;
+          lengths[i] = len;
         }
       }
 
       if (seq_scan_) {
-        for (size_t fidx : rand_indexes) {
-          std::string picked_file = dir_ + "/" + files_[fidx];
-          pos = positions[fidx];
-          len = lengths[fidx];
-
-          int fd;
-          if ((fd = open(picked_file.c_str(), flags)) == -1) {
-            throw IOException("Failed to open " + picked_file + ", error " +
-                              std::to_string(errno));
+        for (size_t i = 0; i < rand_num_files; i++) {
+          size_t fidx = picks[i];
+          pos = positions[i];
+          len = lengths[i];
+
+          int t;
+          if ((t = engine.open(file_dir_fd(fidx), files_[fidx].c_str(),
+                                file_sizes_[fidx])) == -1) {
+            throw IOException("Failed to open " + file_path(fidx) +
+                              ", error " + std::to_string(errno));
           }
           local_files++;
-          timer.stop();
-          if (timer.elapsed_ns() >= max_time_) running = false;
+          if (run_.stopped()) running = false;
 
           if (running) {
-            if (pos > 0 && lseek(fd, pos, SEEK_SET) == -1) {
-              throw IOException("Failed to seek " + picked_file + ", error " +
-                                std::to_string(errno));
+            if (trace.on()) trace.add(TRACE_SCAN, fidx, pos, len);
+            if (!engine.submit(t, pos, len)) {
+              throw IOException("Failed to seek " + file_path(fidx) +
+                                ", error " + std::to_string(errno));
             }
-            timer.stop();
-            if (timer.elapsed_ns() >= max_time_) running = false;
+            if (run_.stopped()) running = false;
           }
 
           while (running && len > 0) {
-            size_t bytes_read = read(fd, buf, buf_size);
+            size_t bytes_read = read_next(t);
             if (bytes_read == 0) break;
             if (bytes_read == IO_ERROR) {
-              throw IOException("Failed to read " + picked_file + ", error " +
-                                std::to_string(errno));
+              throw IOException("Failed to read " + file_path(fidx) +
+                                ", error " + std::to_string(errno));
             }
-            len -= bytes_read;
+            len -= std::min(len, bytes_read);
             local_bytes += bytes_read;
+            local_dir_bytes[file_dirs_[fidx]] += bytes_read;
+            live.add_bytes(bytes_read);
           }
-          close(fd);
+          engine.close(t);
 
           if (!running) break;
 
-          timer.stop();
-          if (timer.elapsed_ns() >= max_time_) {
+          if (run_.stopped()) {
             running = false;
             break;
           }
         }
       } else {
-        std::unordered_map<size_t, int> fds;
-        for (size_t fidx : rand_indexes) {
-          std::string picked_file = dir_ + "/" + files_[fidx];
-          int fd;
-          if ((fd = open(picked_file.c_str(), flags)) == -1) {
-            throw IOException("Failed to open " + picked_file + ", error " +
-                              std::to_string(errno));
+        size_t num_open = 0;
+        for (size_t i = 0; i < rand_num_files; i++) {
+          size_t fidx = picks[i];
+          int t;
+          if ((t = engine.open(file_dir_fd(fidx), files_[fidx].c_str(),
+                                file_sizes_[fidx])) == -1) {
+            throw IOException("Failed to open " + file_path(fidx) +
+                              ", error " + std::to_string(errno));
           }
+          targets[num_open++] = t;
           local_files++;
-          timer.stop();
-          if (timer.elapsed_ns() >= max_time_) running = false;
+          if (run_.stopped()) running = false;
 
           if (running) {
-            pos = positions[fidx];
-            if (pos > 0 && lseek(fd, pos, SEEK_SET) == -1) {
-              std::cout << "fidx = " << fidx << picked_file << std::endl;
-              throw IOException("Failed to seek " + picked_file + ", error " +
-                                std::to_string(errno));
+            if (trace.on())
+              trace.add(TRACE_SCAN, fidx, positions[i], lengths[i]);
+            if (!engine.submit(t, positions[i], lengths[i])) {
+              throw IOException("Failed to seek " + file_path(fidx) +
+                                ", error " + std::to_string(errno));
             }
-            fds.insert({fidx, fd});
           }
 
           if (!running) break;
 
-          timer.stop();
-          if (timer.elapsed_ns() >= max_time_) {
+          if (run_.stopped()) {
             running = false;
             break;
           }
         }
 
-        while (running && !lengths.empty()) {
-          size_t r = get_round(pos_dist(gen), 0, lengths.size() - 1);
-          auto rand_it = std::next(std::begin(lengths), r);
-          size_t rand_fidx = rand_it->first;
-          size_t rand_len = rand_it->second;
-          size_t num_reads =
-              static_cast<size_t>(floor(1.0 * rand_len / buf_size));
+        // Files still being read, one is removed by swapping in the last
+        size_t num_active = num_open;
+        for (size_t i = 0; i < num_active; i++) active[i] = i;
+
+        while (running && num_active > 0) {
+          size_t r = get_round(pos_dist(gen), 0, num_active - 1);
+          size_t i = active[r];
+          size_t rand_fidx = picks[i];
+          // lengths[i] is what is left of the file's range
+          size_t num_reads = std::max<size_t>(
+              1, static_cast<size_t>(floor(1.0 * lengths[i] / buf_size)));
           size_t rand_reads = get_round(pos_dist(gen), 1, num_reads);
 
-          int fd = fds[rand_fidx];
+          int t = targets[i];
 
-          for (size_t i = 0; running && i < rand_reads; i++) {
-            size_t bytes_read = read(fd, buf, buf_size);
-            if (bytes_read == 0) break;
+          bool eof = false;
+          for (size_t n = 0; running && n < rand_reads && lengths[i] > 0;
+               n++) {
+            size_t bytes_read = read_next(t);
+            if (bytes_read == 0) {
+              eof = true;
+              break;
+            }
             if (bytes_read == IO_ERROR) {
-              std::string picked_file = dir_ + "/" + files_[rand_fidx];
-              throw IOException("Failed to read " + picked_file + ", error " +
-                                std::to_string(errno));
+              throw IOException("Failed to read " + file_path(rand_fidx) +
+                                ", error " + std::to_string(errno));
             }
+            lengths[i] -= std::min(lengths[i], bytes_read);
             local_bytes += bytes_read;
+            local_dir_bytes[file_dirs_[rand_fidx]] += bytes_read;
+            live.add_bytes(bytes_read);
 
-            timer.stop();
-            if (timer.elapsed_ns() >= max_time_) running = false;
+            if (run_.stopped()) running = false;
           }
 
-          if (num_reads == rand_reads) lengths.erase(rand_fidx);
+          if (eof || lengths[i] == 0) active[r] = active[--num_active];
         }
 
-        for (auto it : fds) close(it.second);
+        for (size_t i = 0; i < num_open; i++) engine.close(targets[i]);
       }
 
-      local_ops++;
+      end_op();
       if (running) {
-        timer.stop();
-        if (timer.elapsed_ns() >= max_time_) break;
+        if (run_.stopped()) break;
+      }
+    }
+  }
+
+  timer.stop();
+  // Stopped before this worker left warm-up, nothing of it is measured
+  if (warmup.active()) {
+    warm_ops = local_ops;
+    warm_bytes = local_bytes;
+    warm_files = local_files;
+    warm_time = timer.elapsed_ns();
+    warm_compute = local_compute;
+    warm_stall = local_stall;
+    warm_dir_bytes = local_dir_bytes;
+    live.end_warmup();
+    usage_start = CpuUsage::thread();
+    perf.start();
+  }
+  perf.stop();
+  CpuUsage usage = CpuUsage::thread() - usage_start;
+
+  if (pipeline_) active_readers_.fetch_sub(1, std::memory_order_release);
+
+  size_t bytes = local_bytes - warm_bytes;
+  update_stats(thread, timer.elapsed_ns() - warm_time, local_ops - warm_ops,
+               bytes, static_cast<size_t>(floor(1.0 * bytes / record_size_)),
+               local_files - warm_files, local_compute - warm_compute,
+               local_stall - warm_stall, compute);
+  for (size_t d = 0; d < dirs_.size(); d++)
+    local_dir_bytes[d] -= warm_dir_bytes[d];
+  add_dir_bytes(local_dir_bytes);
+  add_trace(trace.records());
+  record_warmup(warm_ops, warm_bytes, warm_time, warmup.by_steady());
+  update_usage(usage, perf.counts());
+}
+
+void FileScan::do_consume() {
+  Compute compute(compute_.kernel(), compute_.column_width(),
+                  compute_.selectivity(), compute_.isa());
+  long long local_compute = 0;
+  long long local_stall = 0;
+  size_t local_buffers = 0;
+
+  CpuUsage usage_start = CpuUsage::thread();
+  PerfGroup perf(counters_);
+  perf.start();
+
+  TscTimer ctimer;
+  TscTimer stimer;
+  size_t slot;
+  while (true) {
+    if (!full_ring_->pop(&slot)) {
+      bool done = false;
+      stimer.start();
+      while (!full_ring_->pop(&slot)) {
+        // Readers publish their last buffer before leaving, so one more pop
+        // after they are all gone drains the ring.
+        if (active_readers_.load(std::memory_order_acquire) == 0) {
+          done = !full_ring_->pop(&slot);
+          break;
+        }
+        std::this_thread::yield();
       }
+      stimer.stop();
+      if (done) break;
+      local_stall += stimer.elapsed_ns();
     }
+
+    ctimer.start();
+    compute.consume(ring_bufs_[slot], ring_lens_[slot]);
+    ctimer.stop();
+    local_compute += ctimer.elapsed_ns();
+    local_buffers++;
+
+    free_ring_->push(slot);
   }
 
-  delete[] buf;
+  perf.stop();
+  update_usage(CpuUsage::thread() - usage_start, perf.counts());
 
-  update_stats(timer.elapsed_ns(), local_ops, local_bytes,
-               static_cast<size_t>(floor(1.0 * local_bytes / record_size_)),
-               local_files);
+  const std::lock_guard<std::mutex> lock(mtx_);
+  total_compute_time_ += local_compute;
+  total_consumer_stall_ += local_stall;
+  total_buffers_ += local_buffers;
+  compute_.merge(compute);
 }
 
-void FileScan::update_stats(long long time, size_t ops, size_t bytes,
-                            size_t records, size_t files) {
+void FileScan::update_stats(int thread, long long time, size_t ops,
+                            size_t bytes, size_t records, size_t files,
+                            long long compute_time, long long stall_time,
+                            const Compute &compute) {
   const std::lock_guard<std::mutex> lock(mtx_);
+  record_thread({thread, ops, bytes, records, files, time});
   if (time > total_time_) total_time_ = time;
+  total_io_time_ += time - compute_time;
+  total_reader_stall_ += stall_time;
+  total_compute_time_ += compute_time;
+  compute_.merge(compute);
   total_ops_ += ops;
   total_bytes_ += bytes;
   total_records_ += records;
   total_files_ += files;
 }
 
+// Scan totals and the compute state of a worker process
+struct ScanProcTotals {
+  size_t files;
+  long long io_time;
+  long long compute_time;
+  size_t buffers;
+  long long reader_stall;
+  long long consumer_stall;
+};
+
+size_t FileScan::proc_extra_size() const {
+  return sizeof(ScanProcTotals) + sizeof(Compute);
+}
+
+void FileScan::save_proc_extra(char *buf) const {
+  static_assert(std::is_trivially_copyable<Compute>::value,
+                "Compute is copied between processes");
+  ScanProcTotals totals = {total_files_,        total_io_time_,
+                           total_compute_time_, total_buffers_,
+                           total_reader_stall_, total_consumer_stall_};
+  memcpy(buf, &totals, sizeof(totals));
+  memcpy(buf + sizeof(totals), &compute_, sizeof(Compute));
+}
+
+void FileScan::merge_proc_extra(const char *buf) {
+  ScanProcTotals totals;
+  memcpy(&totals, buf, sizeof(totals));
+  Compute compute = compute_;
+  memcpy(&compute, buf + sizeof(totals), sizeof(Compute));
+  total_files_ += totals.files;
+  total_io_time_ += totals.io_time;
+  total_compute_time_ += totals.compute_time;
+  total_buffers_ += totals.buffers;
+  total_reader_stall_ += totals.reader_stall;
+  total_consumer_stall_ += totals.consumer_stall;
+  compute_.merge(compute);
+}
+
 void FileScan::print_arguments() {
+  arguments_.clear();
   print_argument("page-size", get_page_size());
-  print_argument("block-size", get_block_size());
+  print_argument("block-size", block_size_);
   print_argument("dir", dir_);
   print_argument("record-size", record_size_);
   print_argument("max-time", std::to_string(max_time_));
   print_argument("buffered", buffered_);
   print_argument("threads", std::to_string(num_threads_));
+  print_dir_arguments();
+  if (procs_ > 1) print_argument("procs", std::to_string(procs_));
+  print_class_arguments();
+  print_argument("hugepages", huge_pages_name(huge_pages_));
   print_argument("file-ratio", min_files_, max_files_);
   if (size_bounds_.is_ratio)
     print_argument("size-ratio", size_bounds_.min_ratio,
@@ -457,6 +822,28 @@ void FileScan::print_arguments() {
   print_argument("seq-file", seq_file_);
   print_argument("seq-scan", seq_scan_);
   print_argument("full-middle", full_middle_);
+  print_argument("engine", engine_name(engine_));
+  if (chunk_size_ > 0) print_argument("chunk-size", chunk_size_);
+  if (engine_ == Engine::URING) print_argument("depth", engine_depth_);
+  print_argument("compute", Compute::kernel_name(compute_.kernel()));
+  if (compute_.kernel() != Compute::NONE) {
+    print_argument("column-width", compute_.column_width());
+    if (compute_.kernel() == Compute::COUNT)
+      print_argument("selectivity", std::to_string(compute_.selectivity()));
+    print_argument("simd", Compute::isa_name(compute_.isa()));
+  }
+  print_argument("pipeline", pipeline_);
+  if (pipeline_) {
+    print_argument("consumers", std::to_string(num_consumers_));
+    print_argument("ring-depth", ring_depth_);
+    print_argument("buffer-size", ring_buf_size_);
+  }
+  if (counters_) print_argument("counters", counters_);
+  if (cache_mode_ != CacheMode::AS_IS)
+    print_argument("cache", cache_mode_name(cache_mode_));
+  if (mem_limit_ > 0) print_argument("mem-limit", mem_limit_);
+  if (!trace_path_.empty()) print_argument("trace", trace_path_);
+  print_warmup_arguments();
 }
 
 }  // namespace tps
\ No newline at end of file
@@ -1,14 +1,18 @@
 #ifndef FILE_SCAN_HPP
 #define FILE_SCAN_HPP
 
+#include <atomic>
 #include <limits>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <utility>
 
+#include "compute.hpp"
 #include "file_read.hpp"
 #include "helper.hpp"
 #include "io_exception.hpp"
+#include "ring_queue.hpp"
 
 namespace tps {
 
@@ -56,9 +60,42 @@ class FileScan : public FileRead {
            const Bounds &in_bounds, bool sequential_files, bool sequential_scan,
            bool full_middle);
 
+  // Scans the files of a list loaded before, e.g. by an earlier sweep point
+  FileScan(std::shared_ptr<const FileList> list, size_t record_size,
+           long long max_time, bool buffered, int num_threads,
+           const Bounds &ex_bounds, const Bounds &in_bounds,
+           bool sequential_files, bool sequential_scan, bool full_middle);
+
   void start_read();
 
+  // Run a compute kernel over every buffer that is read
+  void set_compute(const Compute &compute);
+
+  // Split the scan into reader threads that fill a ring of aligned buffers
+  // and consumer threads that run the compute kernel over them
+  void set_pipeline(int num_consumers, size_t ring_depth, size_t buffer_size);
+
   size_t total_files() const { return total_files_; }
+  const Compute &compute() const { return compute_; }
+
+  // Time spent on I/O and on the compute kernel, averaged over threads
+  long long io_time() const { return total_io_time_ / num_workers(); }
+  long long compute_time() const {
+    return total_compute_time_ /
+           (pipeline_ ? num_consumers_ * procs_ : num_workers());
+  }
+
+  // Time readers waited for a free buffer and consumers waited for a full
+  // one, averaged over the threads on each side
+  long long reader_stall_time() const {
+    return total_reader_stall_ / num_workers();
+  }
+  long long consumer_stall_time() const {
+    return num_consumers_ > 0
+               ? total_consumer_stall_ / (num_consumers_ * procs_)
+               : 0;
+  }
+  size_t total_buffers() const { return total_buffers_; }
 
   void print_arguments();
 
@@ -72,14 +109,40 @@ class FileScan : public FileRead {
   bool full_scan_;
 
   size_t total_files_;
+  Compute compute_;
+  long long total_io_time_;
+  long long total_compute_time_;
+
+  bool pipeline_;
+  int num_consumers_;
+  size_t ring_depth_;
+  size_t ring_buf_size_;
+  std::vector<char *> ring_bufs_;
+  std::vector<size_t> ring_lens_;
+  std::unique_ptr<RingQueue<size_t>> free_ring_;
+  std::unique_ptr<RingQueue<size_t>> full_ring_;
+  std::atomic<int> active_readers_;
+  size_t total_buffers_;
+  long long total_reader_stall_;
+  long long total_consumer_stall_;
 
   static void rand_read_info(size_t *pos, size_t *read_size, size_t file_size,
                              double pos_ratio, double size_ratio,
                              size_t align_size);
 
-  void do_read();
-  void update_stats(long long time, size_t ops, size_t bytes, size_t records,
-                    size_t files);
+  size_t proc_extra_size() const;
+  void save_proc_extra(char *buf) const;
+  void merge_proc_extra(const char *buf);
+
+  void run_threads();
+  void start_pipeline();
+  void do_read(int thread);
+  template <class IoEngine>
+  void do_read_with(int thread);
+  void do_consume();
+  void update_stats(int thread, long long time, size_t ops, size_t bytes,
+                    size_t records, size_t files, long long compute_time,
+                    long long stall_time, const Compute &compute);
 };
 
 }  // namespace tps
@@ -1,6 +1,7 @@
 
 #include "file_write.hpp"
 
+#include <sys/statvfs.h>
 #include <unistd.h>
 
 #include <algorithm>
@@ -11,8 +12,10 @@
 #include <random>
 #include <vector>
 
+#include "file_list.hpp"
 #include "helper.hpp"
 #include "io_exception.hpp"
+#include "perf_counter.hpp"
 #include "timer.hpp"
 
 namespace tps {
@@ -20,26 +23,74 @@ namespace tps {
 FileWrite::FileWrite(const std::string dir_path, size_t total_size,
                      size_t file_size, bool sequential)
     : dir_(dir_path),
+      dirs_(split_dirs(dir_path)),
+      stripe_(Stripe::ROUND_ROBIN),
       total_(total_size),
       size_(file_size > total_size || file_size == 0 ? total_size : file_size),
-      seq_(sequential) {
-  bool is_dir;
-  bool exists = file_exists(dir_, &is_dir);
-  if (exists) {
-    if (!is_dir) throw IOException(dir_ + " is not a directory.");
-    for (std::string f : list_dir(dir_)) {
-      if (has_suffix(f, ".bin", false))
-        throw IOException(dir_path + " is not empty.");
+      seq_(sequential),
+      huge_pages_(HugePages::OFF),
+      counters_(false),
+      manifest_(false),
+      output_(Output::TEXT) {
+  if (dirs_.empty()) throw IOException("No directory given");
+  if (dirs_.size() > FileList::MAX_DIRS)
+    throw IOException("More than " + std::to_string(FileList::MAX_DIRS) +
+                      " directories given");
+  for (const std::string &dir : dirs_) {
+    bool is_dir;
+    bool exists = file_exists(dir, &is_dir);
+    if (exists) {
+      if (!is_dir) throw IOException(dir + " is not a directory.");
+      for (std::string f : list_dir(dir)) {
+        if (has_suffix(f, ".bin", false))
+          throw IOException(dir + " is not empty.");
+      }
+    } else if (mkdir(dir.c_str(), 0755) != 0) {
+      throw IOException("Failed to mkdir " + dir);
     }
-  } else if (mkdir(dir_.c_str(), 0755) != 0) {
-    throw IOException("Failed to mkdir " + dir_);
   }
 }
 
+std::vector<size_t> FileWrite::assign_dirs(size_t num_files) const {
+  std::vector<size_t> assigned(num_files);
+  if (stripe_ == Stripe::ROUND_ROBIN || dirs_.size() == 1) {
+    for (size_t i = 0; i < num_files; i++) assigned[i] = i % dirs_.size();
+    return assigned;
+  }
+
+  // Free space seen by unprivileged users, ties go to the earlier directory
+  std::vector<double> capacity(dirs_.size());
+  for (size_t d = 0; d < dirs_.size(); d++) {
+    struct statvfs st;
+    if (statvfs(dirs_[d].c_str(), &st) != 0)
+      throw IOException("Failed to statvfs " + dirs_[d] + ", error " +
+                        std::to_string(errno));
+    capacity[d] = 1.0 * st.f_bavail * st.f_frsize;
+  }
+  std::vector<double> used(dirs_.size(), 0.0);
+  for (size_t i = 0; i < num_files; i++) {
+    size_t best = 0;
+    double best_share = -1.0;
+    for (size_t d = 0; d < dirs_.size(); d++) {
+      if (capacity[d] <= 0.0) continue;
+      double share = (used[d] + size_) / capacity[d];
+      if (best_share < 0.0 || share < best_share) {
+        best = d;
+        best_share = share;
+      }
+    }
+    used[best] += size_;
+    assigned[i] = best;
+  }
+  return assigned;
+}
+
 std::unordered_map<std::string, long long> FileWrite::write() {
   std::vector<std::string> files;
+  file_dirs_.clear();
   if (size_ == total_) {
     files.push_back("0.bin");
+    file_dirs_["0.bin"] = 0;
   } else {
     size_t num_files =
         static_cast<size_t>(ceil(static_cast<double>(total_) / size_));
@@ -52,6 +103,12 @@ std::unordered_map<std::string, long long> FileWrite::write() {
       files.push_back(name + ".bin");
     }
 
+    // Directories are assigned by file number, so the layout does not
+    // depend on the write order
+    std::vector<size_t> assigned = assign_dirs(num_files);
+    for (size_t i = 0; i < num_files; ++i)
+      file_dirs_[files[i]] = assigned[i];
+
     if (!seq_) {
       unsigned seed =
           std::chrono::system_clock::now().time_since_epoch().count();
@@ -62,18 +119,24 @@ std::unordered_map<std::string, long long> FileWrite::write() {
 
   size_t buf_size = 128 * 1024 * 1024;  // 128 MB
   if (buf_size > size_) buf_size = size_;
-  char *buf = new char[buf_size];
+  char *buf = alloc_buffer(buf_size, huge_pages_);
 
   std::fstream rs;
   rs.open("/dev/urandom", std::ios::in | std::ios::binary);
 
   std::unordered_map<std::string, long long> ret;
   ret.reserve(files.size());
+  disk_io_ = DiskIo(dirs_);
+  disk_io_.begin();
+  CpuUsage usage_start = CpuUsage::thread();
+  PerfGroup perf(counters_);
+  perf.start();
+
   HighResTimer timer;
   for (std::string name : files) {
     timer.start();
     std::fstream fs;
-    fs.open(dir_ + "/" + name, std::ios::out | std::ios::binary);
+    fs.open(file_path(name), std::ios::out | std::ios::binary);
 
     size_t remains = size_;
     while (remains > 0) {
@@ -90,17 +153,44 @@ std::unordered_map<std::string, long long> FileWrite::write() {
 
     ret.insert({name, timer.elapsed_ns()});
   }
-  delete[] buf;
+  perf.stop();
+  usage_ = CpuUsage::thread() - usage_start;
+  perf_ = perf.counts();
+  disk_io_.end();
+
+  free_buffer(buf, buf_size, huge_pages_);
+  if (manifest_) {
+    // One manifest per directory with the files written there
+    std::vector<std::vector<std::string>> dir_files(dirs_.size());
+    for (const std::string &name : files)
+      dir_files[file_dirs_[name]].push_back(name);
+    for (size_t d = 0; d < dirs_.size(); d++) {
+      if (dir_files[d].empty()) continue;
+      write_manifest(dirs_[d], dir_files[d],
+                     std::vector<size_t>(dir_files[d].size(), size_));
+    }
+  }
   return ret;
 }
 
 void FileWrite::print_arguments() {
-  std::cout << "# page-size = " << get_page_size() << std::endl;
-  std::cout << "# block-size = " << get_block_size() << std::endl;
-  std::cout << "# dir = " << dir_ << std::endl;
-  std::cout << "# total-size = " << total_ << std::endl;
-  std::cout << "# file-size = " << size_ << std::endl;
-  std::cout << "# sequential = " << (seq_ ? "true" : "false") << std::endl;
+  arguments_.clear();
+  arguments_.push_back({"page-size", std::to_string(get_page_size())});
+  size_t block_size = 0;
+  for (const std::string &dir : dirs_)
+    block_size = std::max(block_size, get_block_size(dir));
+  arguments_.push_back({"block-size", std::to_string(block_size)});
+  arguments_.push_back({"dir", dir_});
+  if (dirs_.size() > 1) arguments_.push_back({"stripe", stripe_name(stripe_)});
+  arguments_.push_back({"total-size", std::to_string(total_)});
+  arguments_.push_back({"file-size", std::to_string(size_)});
+  arguments_.push_back({"sequential", seq_ ? "true" : "false"});
+  arguments_.push_back({"hugepages", huge_pages_name(huge_pages_)});
+  if (counters_) arguments_.push_back({"counters", "true"});
+  if (manifest_) arguments_.push_back({"manifest", "true"});
+  if (output_ != Output::TEXT) return;
+  for (const auto &arg : arguments_)
+    std::cout << "# " << arg.first << " = " << arg.second << std::endl;
 }
 
 }  // namespace tps
@@ -3,9 +3,39 @@
 
 #include <string>
 #include <unordered_map>
+#include <vector>
+
+#include "buffer.hpp"
+#include "cpu_usage.hpp"
+#include "disk_io.hpp"
+#include "helper.hpp"
+#include "perf_counter.hpp"
+#include "report.hpp"
 
 namespace tps {
 
+// How files are spread over the directories of a write. ROUND_ROBIN deals
+// them in turn, CAPACITY to the directory with the lowest share of its free
+// space used so far, so a larger device gets more files.
+enum class Stripe { ROUND_ROBIN, CAPACITY };
+
+static bool parse_stripe(const std::string &str, Stripe *stripe) {
+  std::string value = to_lower(str);
+  if (value.compare("round-robin") == 0)
+    *stripe = Stripe::ROUND_ROBIN;
+  else if (value.compare("capacity") == 0)
+    *stripe = Stripe::CAPACITY;
+  else
+    return false;
+  return true;
+}
+
+static std::string stripe_name(Stripe stripe) {
+  return stripe == Stripe::CAPACITY ? "capacity" : "round-robin";
+}
+
+// Writes the files to one directory or stripes them over several given as
+// "dir1,dir2,..."
 class FileWrite {
  public:
   FileWrite(const std::string dir_path, size_t total_size, size_t file_size,
@@ -13,13 +43,63 @@ class FileWrite {
 
   std::unordered_map<std::string, long long> write();
 
+  // Back the write buffer with huge pages
+  void set_huge_pages(HugePages mode) { huge_pages_ = mode; }
+
+  // Count cycles, instructions and LLC misses next to the dTLB misses
+  void set_counters(bool counters) { counters_ = counters; }
+
+  // Leave a manifest of the files so that readers skip listing them
+  void set_manifest(bool manifest) { manifest_ = manifest; }
+
+  void set_stripe(Stripe stripe) { stripe_ = stripe; }
+
+  // Directories written to and the path of a file returned by write()
+  const std::vector<std::string> &dirs() const { return dirs_; }
+  size_t file_dir(const std::string &name) const {
+    return file_dirs_.at(name);
+  }
+  std::string file_path(const std::string &name) const {
+    return dirs_[file_dir(name)] + "/" + name;
+  }
+
+  // CPU time, context switches, page faults and hardware counters taken
+  // while writing
+  const CpuUsage &cpu_usage() const { return usage_; }
+  size_t minor_faults() const { return usage_.minor_faults; }
+  size_t major_faults() const { return usage_.major_faults; }
+  const PerfCounts &perf_counts() const { return perf_; }
+
+  // Process and device I/O while writing. Writes are not synced, so the
+  // devices only see what writeback flushed meanwhile.
+  const DiskIo &disk_io() const { return disk_io_; }
+
+  // Arguments are recorded for structured output and only printed as text
+  void set_output(Output output) { output_ = output; }
+
   void print_arguments();
 
+  const Arguments &arguments() const { return arguments_; }
+
  private:
+  // Directory index of each file, by the stripe mode
+  std::vector<size_t> assign_dirs(size_t num_files) const;
+
   std::string dir_;
+  std::vector<std::string> dirs_;
+  std::unordered_map<std::string, size_t> file_dirs_;
+  Stripe stripe_;
   size_t total_;
   size_t size_;
   bool seq_;
+  HugePages huge_pages_;
+  CpuUsage usage_;
+  bool counters_;
+  bool manifest_;
+  PerfCounts perf_;
+  DiskIo disk_io_;
+  Output output_;
+  Arguments arguments_;
 };
 
 }  // namespace tps
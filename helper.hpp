@@ -2,6 +2,8 @@
 #define HELPER_HPP
 
 #include <dirent.h>
+#include <fcntl.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -54,6 +56,22 @@ static std::pair<std::string, std::string> parse_arg(const std::string &value) {
   return ret;
 }
 
+// Parse {true, t, yes, y, 1, false, f, no, n, 0}, return false if invalid
+static bool parse_bool(const std::string &str, bool *value) {
+  std::string tmp = to_upper(str);
+  if (tmp.compare("TRUE") == 0 || tmp.compare("T") == 0 ||
+      tmp.compare("YES") == 0 || tmp.compare("Y") == 0 ||
+      tmp.compare("1") == 0)
+    *value = true;
+  else if (tmp.compare("FALSE") == 0 || tmp.compare("F") == 0 ||
+           tmp.compare("NO") == 0 || tmp.compare("N") == 0 ||
+           tmp.compare("0") == 0)
+    *value = false;
+  else
+    return false;
+  return true;
+}
+
 static size_t to_size_t(const std::string &str) {
   std::stringstream ss(str);
   size_t n;
@@ -84,18 +102,19 @@ static size_t size_in_bytes(const std::string &size) {
 
 static long long time_in_ns(const std::string &time) {
   size_t l = time.size();
+  // Two letter units first, "ms" also ends with "s"
   if (has_suffix(time, "h", false))
     return std::stoll(time.substr(0, l - 1)) * 60 * 60 * 1000 * 1000 * 1000;
   else if (has_suffix(time, "min", false))
     return std::stoll(time.substr(0, l - 3)) * 60 * 1000 * 1000 * 1000;
-  else if (has_suffix(time, "s", false))
-    return std::stoll(time.substr(0, l - 1)) * 1000 * 1000 * 1000;
   else if (has_suffix(time, "ms", false))
     return std::stoll(time.substr(0, l - 2)) * 1000 * 1000;
   else if (has_suffix(time, "us", false))
     return std::stoll(time.substr(0, l - 2)) * 1000;
   else if (has_suffix(time, "ns", false))
     return std::stoll(time.substr(0, l - 2));
+  else if (has_suffix(time, "s", false))
+    return std::stoll(time.substr(0, l - 1)) * 1000 * 1000 * 1000;
   else
     return std::stoll(time);
 }
@@ -123,10 +142,40 @@ static std::vector<std::string> list_dir(const std::string &dir_path) {
   return files;
 }
 
-static size_t get_block_size() {
+// Direct I/O alignment of the filesystem holding path, for the memory of
+// the buffers and for file offsets and lengths. statx reports both since
+// Linux 6.1, otherwise buffers are page aligned and offsets use the block
+// size of the filesystem.
+static void get_dio_align(const std::string &path, size_t *mem_align,
+                          size_t *offset_align) {
+  *mem_align = static_cast<size_t>(sysconf(_SC_PAGE_SIZE));
+  *offset_align = 4096;
+#ifdef STATX_DIOALIGN
+  struct statx stx;
+  if (statx(AT_FDCWD, path.c_str(), 0, STATX_DIOALIGN, &stx) == 0 &&
+      (stx.stx_mask & STATX_DIOALIGN) && stx.stx_dio_offset_align > 0) {
+    *mem_align = std::max<size_t>(*mem_align, stx.stx_dio_mem_align);
+    *offset_align = stx.stx_dio_offset_align;
+    return;
+  }
+#endif
   struct stat st_f;
-  stat("/", &st_f);
-  return static_cast<size_t>(st_f.st_blksize);
+  if (stat(path.c_str(), &st_f) == 0 && st_f.st_blksize > 0)
+    *offset_align = static_cast<size_t>(st_f.st_blksize);
+}
+
+// Alignment of O_DIRECT offsets and lengths on the filesystem of path
+static size_t get_block_size(const std::string &path) {
+  size_t mem_align, offset_align;
+  get_dio_align(path, &mem_align, &offset_align);
+  return offset_align;
+}
+
+// Alignment of O_DIRECT buffers on the filesystem of path
+static size_t get_dio_mem_align(const std::string &path) {
+  size_t mem_align, offset_align;
+  get_dio_align(path, &mem_align, &offset_align);
+  return mem_align;
 }
 
 static size_t get_page_size() {
@@ -151,6 +200,21 @@ static size_t get_file_blocks(const std::string &path) {
   return static_cast<size_t>(st.st_blocks);
 }
 
+// User and system CPU time consumed so far by the calling thread
+static void get_thread_cpu_time(long long *user_ns, long long *sys_ns) {
+  struct rusage ru;
+  getrusage(RUSAGE_THREAD, &ru);
+  *user_ns = ru.ru_utime.tv_sec * 1000000000LL + ru.ru_utime.tv_usec * 1000LL;
+  *sys_ns = ru.ru_stime.tv_sec * 1000000000LL + ru.ru_stime.tv_usec * 1000LL;
+}
+
+// Nanoseconds per GB (2^30 bytes) moved
+static long long to_ns_per_gb(long long time_in_ns, size_t size) {
+  if (size == 0) return 0;
+  return static_cast<long long>(
+      round(1.0 * time_in_ns * 1024 * 1024 * 1024 / size));
+}
+
 static size_t to_bytes_per_sec(size_t size, long long time_in_ns) {
   double time_in_s = 0.001 * time_in_ns * 0.001 * 0.001;
   return static_cast<size_t>(round(1.0 * size / time_in_s));
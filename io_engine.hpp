@@ -0,0 +1,445 @@
+#ifndef IO_ENGINE_HPP
+#define IO_ENGINE_HPP
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "buffer.hpp"
+#include "helper.hpp"
+#include "io_exception.hpp"
+#include "uring.hpp"
+
+namespace tps {
+
+// How bytes are moved out of the files. read, pread and preadv copy into a
+// user buffer, mmap maps the file and touches its pages, splice and sendfile
+// move pages to /dev/null without copying, uring keeps several chunks of
+// each file in flight.
+enum class Engine { READ, PREAD, PREADV, MMAP, SPLICE, SENDFILE, URING };
+
+static bool parse_engine(const std::string &str, Engine *engine) {
+  std::string value = to_lower(str);
+  if (value.compare("read") == 0)
+    *engine = Engine::READ;
+  else if (value.compare("pread") == 0)
+    *engine = Engine::PREAD;
+  else if (value.compare("preadv") == 0)
+    *engine = Engine::PREADV;
+  else if (value.compare("mmap") == 0)
+    *engine = Engine::MMAP;
+  else if (value.compare("splice") == 0)
+    *engine = Engine::SPLICE;
+  else if (value.compare("sendfile") == 0)
+    *engine = Engine::SENDFILE;
+  else if (value.compare("uring") == 0)
+    *engine = Engine::URING;
+  else
+    return false;
+  return true;
+}
+
+static std::string engine_name(Engine engine) {
+  switch (engine) {
+    case Engine::PREAD:
+      return "pread";
+    case Engine::PREADV:
+      return "preadv";
+    case Engine::MMAP:
+      return "mmap";
+    case Engine::SPLICE:
+      return "splice";
+    case Engine::SENDFILE:
+      return "sendfile";
+    case Engine::URING:
+      return "uring";
+    default:
+      return "read";
+  }
+}
+
+// True if the engine hands out the file contents in user memory
+static bool engine_has_data(Engine engine) {
+  return engine != Engine::SPLICE && engine != Engine::SENDFILE;
+}
+
+// True if the engine can read into a buffer owned by the caller
+static bool engine_copies(Engine engine) {
+  return engine == Engine::READ || engine == Engine::PREAD ||
+         engine == Engine::PREADV;
+}
+
+struct EngineConfig {
+  size_t chunk_size;   // bytes returned per reap
+  size_t record_size;  // iovec size for preadv
+  size_t max_targets;  // targets open at the same time
+  size_t depth;        // chunks in flight per target for uring
+  size_t io_align;     // length alignment of O_DIRECT reads, 0 if buffered
+  bool buffered;
+  bool own_buffer;  // false if every reap passes a destination buffer
+  HugePages huge_pages;
+  size_t mem_align;  // buffer alignment for O_DIRECT, 0 for a page
+};
+
+// All engines share the same interface and are picked with a template
+// parameter, so the hot loops inline the system calls:
+//   int open(int dir_fd, const char *name, size_t file_size)
+//     Open a target, returns its handle or -1 with errno set.
+//   bool submit(int t, size_t pos, size_t len)
+//     Start reading [pos, pos + len) of the target, false with errno set on
+//     error.
+//   size_t reap(int t, char *dst, const char **data)
+//     Next chunk of the range, returns bytes read, 0 at the end of the range
+//     or of the file, or IO_ERROR with errno set. A target that was never
+//     submitted is read to the end of the file. Copying engines read into
+//     dst when it is not null. *data stays valid until the next reap.
+//   void close(int t)
+//     Close the target.
+class EngineBase {
+ public:
+  static constexpr size_t IO_ERROR = (size_t)-1;
+
+  explicit EngineBase(const EngineConfig &config)
+      : config_(config),
+        flags_(O_RDONLY | (config.buffered ? 0 : O_DIRECT)),
+        buf_(nullptr) {
+    size_t max_targets = std::max<size_t>(1, config_.max_targets);
+    targets_.resize(max_targets);
+    free_targets_.reserve(max_targets);
+    for (size_t i = 0; i < max_targets; i++)
+      free_targets_.push_back(static_cast<int>(max_targets - 1 - i));
+    if (config_.own_buffer)
+      buf_ = alloc_buffer(config_.chunk_size, config_.huge_pages,
+                          config_.mem_align);
+  }
+
+  ~EngineBase() { free_buffer(buf_, config_.chunk_size, config_.huge_pages); }
+
+  EngineBase(const EngineBase &) = delete;
+  EngineBase &operator=(const EngineBase &) = delete;
+
+  int open(int dir_fd, const char *name, size_t file_size) {
+    int fd = openat(dir_fd, name, flags_);
+    if (fd == -1) return -1;
+    int t = free_targets_.back();
+    free_targets_.pop_back();
+    targets_[t].fd = fd;
+    targets_[t].size = file_size;
+    targets_[t].pos = 0;
+    targets_[t].end = NO_END;
+    return t;
+  }
+
+  void close(int t) {
+    ::close(targets_[t].fd);
+    free_targets_.push_back(t);
+  }
+
+  // False if the kernel refused to register io_uring buffers
+  bool fixed_buffers() const { return true; }
+
+ protected:
+  static constexpr size_t NO_END = (size_t)-1;
+
+  struct Target {
+    int fd;
+    size_t size;
+    size_t pos;
+    size_t end;  // of the submitted range
+    char *map;
+  };
+
+  void set_range(int t, size_t pos, size_t len) {
+    targets_[t].pos = pos;
+    targets_[t].end = len > NO_END - pos ? NO_END : pos + len;
+  }
+
+  // Bytes of the next reap, no more than the range has left but rounded up
+  // to whole blocks for O_DIRECT. 0 once the range is used up.
+  size_t chunk_left(const Target &target) const {
+    if (target.pos >= target.end) return 0;
+    size_t n = std::min(config_.chunk_size, target.end - target.pos);
+    size_t align = config_.io_align;
+    if (align > 1)
+      n = std::min(config_.chunk_size, (n + align - 1) / align * align);
+    return n;
+  }
+
+  EngineConfig config_;
+  int flags_;
+  char *buf_;
+  std::vector<Target> targets_;
+  std::vector<int> free_targets_;
+};
+
+// read(2) from the file position, the access of the original loops
+class ReadEngine : public EngineBase {
+ public:
+  explicit ReadEngine(const EngineConfig &config) : EngineBase(config) {}
+
+  bool submit(int t, size_t pos, size_t len) {
+    set_range(t, pos, len);
+    return pos == 0 || lseek(targets_[t].fd, pos, SEEK_SET) != -1;
+  }
+
+  size_t reap(int t, char *dst, const char **data) {
+    Target &target = targets_[t];
+    char *buf = dst != nullptr ? dst : buf_;
+    *data = buf;
+    size_t n = chunk_left(target);
+    if (n == 0) return 0;
+    ssize_t m = read(target.fd, buf, n);
+    if (m < 0) return IO_ERROR;
+    target.pos += m;
+    return static_cast<size_t>(m);
+  }
+};
+
+// pread(2) at an offset tracked in user space, no lseek per range
+class PreadEngine : public EngineBase {
+ public:
+  explicit PreadEngine(const EngineConfig &config) : EngineBase(config) {}
+
+  bool submit(int t, size_t pos, size_t len) {
+    set_range(t, pos, len);
+    return true;
+  }
+
+  size_t reap(int t, char *dst, const char **data) {
+    Target &target = targets_[t];
+    char *buf = dst != nullptr ? dst : buf_;
+    *data = buf;
+    size_t len = chunk_left(target);
+    if (len == 0) return 0;
+    ssize_t n = pread(target.fd, buf, len, target.pos);
+    if (n < 0) return IO_ERROR;
+    target.pos += n;
+    return static_cast<size_t>(n);
+  }
+};
+
+// preadv(2) of each chunk as record sized iovecs laid out back to back
+class PreadvEngine : public EngineBase {
+ public:
+  explicit PreadvEngine(const EngineConfig &config) : EngineBase(config) {
+    size_t seg = std::max<size_t>(1, config_.record_size);
+    size_t num_segs = (config_.chunk_size + seg - 1) / seg;
+    if (num_segs > IOV_MAX) {
+      // Grow the iovecs by whole records to stay block aligned
+      seg *= (num_segs + IOV_MAX - 1) / IOV_MAX;
+      num_segs = (config_.chunk_size + seg - 1) / seg;
+    }
+    iovs_.resize(num_segs);
+    seg_size_ = seg;
+  }
+
+  bool submit(int t, size_t pos, size_t len) {
+    set_range(t, pos, len);
+    return true;
+  }
+
+  size_t reap(int t, char *dst, const char **data) {
+    Target &target = targets_[t];
+    char *buf = dst != nullptr ? dst : buf_;
+    *data = buf;
+    size_t left = chunk_left(target);
+    if (left == 0) return 0;
+    int num_segs = 0;
+    for (; left > 0; num_segs++) {
+      iovs_[num_segs].iov_base = buf + num_segs * seg_size_;
+      iovs_[num_segs].iov_len = std::min(seg_size_, left);
+      left -= iovs_[num_segs].iov_len;
+    }
+    ssize_t n = preadv(target.fd, iovs_.data(), num_segs, target.pos);
+    if (n < 0) return IO_ERROR;
+    target.pos += n;
+    return static_cast<size_t>(n);
+  }
+
+ private:
+  std::vector<struct iovec> iovs_;
+  size_t seg_size_;
+};
+
+// Maps the whole file at open and touches one byte per page of every chunk,
+// so the page faults do the reading
+class MmapEngine : public EngineBase {
+ public:
+  explicit MmapEngine(const EngineConfig &config)
+      : EngineBase(config), page_size_(get_page_size()), sink_(0) {
+    // Page cache pages cannot be mapped with O_DIRECT semantics
+    flags_ = O_RDONLY;
+  }
+
+  int open(int dir_fd, const char *name, size_t file_size) {
+    int t = EngineBase::open(dir_fd, name, file_size);
+    if (t == -1) return -1;
+    targets_[t].map = nullptr;
+    if (file_size == 0) return t;
+    void *ptr =
+        mmap(nullptr, file_size, PROT_READ, MAP_SHARED, targets_[t].fd, 0);
+    if (ptr == MAP_FAILED) {
+      int err = errno;
+      EngineBase::close(t);
+      errno = err;
+      return -1;
+    }
+    targets_[t].map = static_cast<char *>(ptr);
+    return t;
+  }
+
+  bool submit(int t, size_t pos, size_t len) {
+    set_range(t, pos, len);
+    return true;
+  }
+
+  size_t reap(int t, char * /*dst*/, const char **data) {
+    Target &target = targets_[t];
+    if (target.pos >= target.size) return 0;
+    size_t n = std::min(chunk_left(target), target.size - target.pos);
+    if (n == 0) return 0;
+    const char *ptr = target.map + target.pos;
+    unsigned char sum = 0;
+    for (size_t off = 0; off < n; off += page_size_) sum += ptr[off];
+    sink_ = sink_ + sum;
+    target.pos += n;
+    *data = ptr;
+    return n;
+  }
+
+  void close(int t) {
+    if (targets_[t].map != nullptr) munmap(targets_[t].map, targets_[t].size);
+    EngineBase::close(t);
+  }
+
+ private:
+  size_t page_size_;
+  volatile unsigned char sink_;
+};
+
+// sendfile(2) from the file position to /dev/null
+class SendfileEngine : public EngineBase {
+ public:
+  explicit SendfileEngine(const EngineConfig &config) : EngineBase(config) {
+    if ((null_fd_ = ::open("/dev/null", O_WRONLY)) == -1)
+      throw IOException("Failed to open /dev/null, error " +
+                        std::to_string(errno));
+  }
+
+  ~SendfileEngine() { ::close(null_fd_); }
+
+  bool submit(int t, size_t pos, size_t len) {
+    set_range(t, pos, len);
+    return pos == 0 || lseek(targets_[t].fd, pos, SEEK_SET) != -1;
+  }
+
+  size_t reap(int t, char * /*dst*/, const char **data) {
+    Target &target = targets_[t];
+    *data = nullptr;
+    size_t len = chunk_left(target);
+    if (len == 0) return 0;
+    ssize_t n = sendfile(null_fd_, target.fd, nullptr, len);
+    if (n < 0) return IO_ERROR;
+    target.pos += n;
+    return static_cast<size_t>(n);
+  }
+
+ private:
+  int null_fd_;
+};
+
+// splice(2) from the file position through a pipe to /dev/null
+class SpliceEngine : public EngineBase {
+ public:
+  explicit SpliceEngine(const EngineConfig &config) : EngineBase(config) {
+    if ((null_fd_ = ::open("/dev/null", O_WRONLY)) == -1)
+      throw IOException("Failed to open /dev/null, error " +
+                        std::to_string(errno));
+    if (pipe(pipe_fds_) == -1) {
+      ::close(null_fd_);
+      throw IOException("Failed to create pipe, error " +
+                        std::to_string(errno));
+    }
+    fcntl(pipe_fds_[1], F_SETPIPE_SZ, static_cast<int>(config_.chunk_size));
+    pipe_size_ = static_cast<size_t>(fcntl(pipe_fds_[1], F_GETPIPE_SZ));
+  }
+
+  ~SpliceEngine() {
+    ::close(pipe_fds_[0]);
+    ::close(pipe_fds_[1]);
+    ::close(null_fd_);
+  }
+
+  bool submit(int t, size_t pos, size_t len) {
+    set_range(t, pos, len);
+    return pos == 0 || lseek(targets_[t].fd, pos, SEEK_SET) != -1;
+  }
+
+  size_t reap(int t, char * /*dst*/, const char **data) {
+    Target &target = targets_[t];
+    *data = nullptr;
+    size_t len = chunk_left(target);
+    size_t total = 0;
+    while (total < len) {
+      ssize_t n = splice(target.fd, nullptr, pipe_fds_[1], nullptr,
+                         std::min(pipe_size_, len - total), SPLICE_F_MOVE);
+      if (n < 0) return IO_ERROR;
+      if (n == 0) break;
+      for (ssize_t left = n; left > 0;) {
+        ssize_t m = splice(pipe_fds_[0], nullptr, null_fd_, nullptr, left,
+                           SPLICE_F_MOVE);
+        if (m <= 0) return IO_ERROR;
+        left -= m;
+      }
+      total += n;
+    }
+    target.pos += total;
+    return total;
+  }
+
+ private:
+  int null_fd_;
+  int pipe_fds_[2];
+  size_t pipe_size_;
+};
+
+// io_uring with up to depth chunks of every submitted range in flight
+class UringEngine : public EngineBase {
+ public:
+  explicit UringEngine(const EngineConfig &config)
+      : EngineBase(config),
+        uring_(config.depth, config.max_targets, config.chunk_size,
+               config.io_align, config.huge_pages, config.mem_align) {}
+
+  bool submit(int t, size_t pos, size_t len) {
+    uring_.open_stream(targets_[t].fd, pos, len);
+    return true;
+  }
+
+  size_t reap(int t, char * /*dst*/, const char **data) {
+    return uring_.read(targets_[t].fd, data);
+  }
+
+  void close(int t) {
+    uring_.close_stream(targets_[t].fd);
+    EngineBase::close(t);
+  }
+
+  bool fixed_buffers() const { return uring_.fixed_buffers(); }
+
+ private:
+  UringReader uring_;
+};
+
+}  // namespace tps
+
+#endif  // IO_ENGINE_HPP
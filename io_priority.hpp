@@ -0,0 +1,80 @@
+#ifndef IO_PRIORITY_HPP
+#define IO_PRIORITY_HPP
+
+#include <errno.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "helper.hpp"
+#include "io_exception.hpp"
+
+namespace tps {
+
+// I/O scheduling class and level of the worker threads, as ionice sets
+// them. Only schedulers that honour priorities (bfq) act on them, NONE
+// leaves the threads as they are.
+struct IoPriority {
+  enum Class { NONE = 0, RT = 1, BE = 2, IDLE = 3 };
+
+  Class io_class;
+  int level;  // 0 (highest) to 7, unused by IDLE
+
+  IoPriority() : io_class(NONE), level(0) {}
+  IoPriority(Class c, int l) : io_class(c), level(l) {}
+
+  bool on() const { return io_class != NONE; }
+};
+
+// {none, idle, rt, be} with an optional /level, e.g. be/0, default level 4
+static bool parse_io_priority(const std::string &str, IoPriority *prio) {
+  std::string value = to_lower(str);
+  std::string name = value.substr(0, value.find('/'));
+  int level = 4;
+  if (name.size() < value.size()) {
+    std::string l = value.substr(name.size() + 1);
+    if (l.size() != 1 || l[0] < '0' || l[0] > '7') return false;
+    level = l[0] - '0';
+  }
+  if (name.compare("none") == 0 && name.size() == value.size())
+    *prio = IoPriority();
+  else if (name.compare("idle") == 0 && name.size() == value.size())
+    *prio = IoPriority(IoPriority::IDLE, 0);
+  else if (name.compare("rt") == 0)
+    *prio = IoPriority(IoPriority::RT, level);
+  else if (name.compare("be") == 0)
+    *prio = IoPriority(IoPriority::BE, level);
+  else
+    return false;
+  return true;
+}
+
+static std::string io_priority_name(const IoPriority &prio) {
+  switch (prio.io_class) {
+    case IoPriority::RT:
+      return "rt/" + std::to_string(prio.level);
+    case IoPriority::BE:
+      return "be/" + std::to_string(prio.level);
+    case IoPriority::IDLE:
+      return "idle";
+    default:
+      return "none";
+  }
+}
+
+// Sets the priority of the calling thread, which its io_uring workers
+// inherit. RT needs CAP_SYS_ADMIN.
+static void apply_io_priority(const IoPriority &prio) {
+  if (!prio.on()) return;
+  static const int IOPRIO_WHO_PROCESS = 1;
+  static const int IOPRIO_CLASS_SHIFT = 13;
+  int value = (prio.io_class << IOPRIO_CLASS_SHIFT) | prio.level;
+  if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, value) != 0)
+    throw IOException("Failed to set I/O priority " + io_priority_name(prio) +
+                      ", error " + std::to_string(errno));
+}
+
+}  // namespace tps
+
+#endif  // IO_PRIORITY_HPP
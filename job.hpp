@@ -0,0 +1,166 @@
+#ifndef JOB_HPP
+#define JOB_HPP
+
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "file_scan.hpp"
+#include "helper.hpp"
+#include "io_exception.hpp"
+
+namespace tps {
+
+// Keys of one phase of a job file. Keys before the first section are
+// defaults inherited by every phase.
+class Phase {
+ public:
+  explicit Phase(const std::string &name) : name_(name) {}
+
+  const std::string &name() const { return name_; }
+
+  void set(const std::string &key, const std::string &value) {
+    args_[key] = value;
+    inherited_.erase(key);
+  }
+
+  bool has(const std::string &key) const {
+    return args_.find(key) != args_.end();
+  }
+
+  std::string get_string(const std::string &key, const std::string &def) {
+    used_.insert(key);
+    auto it = args_.find(key);
+    return it == args_.end() ? def : it->second;
+  }
+
+  size_t get_size(const std::string &key, size_t def) {
+    return has(key) ? size_in_bytes(get_string(key, "")) : use(key, def);
+  }
+
+  size_t get_count(const std::string &key, size_t def) {
+    return has(key) ? to_size_t(get_string(key, "")) : use(key, def);
+  }
+
+  int get_int(const std::string &key, int def) {
+    return has(key) ? std::stoi(get_string(key, "")) : use(key, def);
+  }
+
+  double get_double(const std::string &key, double def) {
+    return has(key) ? std::stod(get_string(key, "")) : use(key, def);
+  }
+
+  long long get_time(const std::string &key, long long def) {
+    return has(key) ? std::max(0LL, time_in_ns(get_string(key, "")))
+                    : use(key, def);
+  }
+
+  bool get_bool(const std::string &key, bool def) {
+    if (!has(key)) return use(key, def);
+    bool value;
+    if (!parse_bool(get_string(key, ""), &value))
+      throw IOException("Value of '" + key + "' in phase '" + name_ +
+                        "' is invalid. Valid values are "
+                        "{true, t, yes, y, 1, false, f, no, n, 0}.");
+    return value;
+  }
+
+  // "m,n" as ratios if either has a dot, otherwise as counts or byte sizes
+  Bounds get_bounds(const std::string &key, bool bytes) {
+    Bounds bounds;
+    if (!has(key)) {
+      used_.insert(key);
+      return bounds;
+    }
+    std::string value = get_string(key, "");
+    size_t cidx = value.find_first_of(",");
+    std::string min = value.substr(0, cidx);
+    std::string max = cidx == std::string::npos ? min : value.substr(cidx + 1);
+    if (min.find_first_of(".") == std::string::npos &&
+        max.find_first_of(".") == std::string::npos) {
+      if (bytes)
+        bounds.set_sizes(size_in_bytes(min), size_in_bytes(max));
+      else
+        bounds.set_sizes(to_size_t(min), to_size_t(max));
+    } else {
+      bounds.set_ratios(std::stod(min), std::stod(max));
+    }
+    return bounds;
+  }
+
+  // Throw on keys that no getter asked for, they are most likely typos
+  void check_unused() const {
+    for (const auto &arg : args_) {
+      if (used_.find(arg.first) == used_.end() &&
+          inherited_.find(arg.first) == inherited_.end())
+        throw IOException("Invalid key '" + arg.first + "' in phase '" +
+                          name_ + "'.");
+    }
+  }
+
+  // Keys set before the first section, they may not apply to every phase
+  void set_inherited(const std::set<std::string> &keys) { inherited_ = keys; }
+
+ private:
+  template <typename T>
+  T use(const std::string &key, T def) {
+    used_.insert(key);
+    return def;
+  }
+
+  std::string name_;
+  std::map<std::string, std::string> args_;
+  std::set<std::string> used_;
+  std::set<std::string> inherited_;
+};
+
+// Parse a job file made of key=value lines grouped in [name] sections.
+// Blank lines and lines starting with '#' or ';' are skipped.
+static std::vector<Phase> parse_job(const std::string &path) {
+  std::ifstream fs(path);
+  if (!fs.is_open()) throw IOException("Failed to open job file " + path);
+
+  Phase defaults("");
+  std::set<std::string> default_keys;
+  std::vector<Phase> phases;
+  std::string line;
+  size_t line_no = 0;
+  while (std::getline(fs, line)) {
+    line_no++;
+    size_t b = line.find_first_not_of(" \t\r");
+    if (b == std::string::npos || line[b] == '#' || line[b] == ';') continue;
+    size_t e = line.find_last_not_of(" \t\r");
+    line = line.substr(b, e - b + 1);
+
+    if (line[0] == '[') {
+      if (line.back() != ']' || line.size() < 3)
+        throw IOException("Invalid section at line " +
+                          std::to_string(line_no) + " of " + path);
+      phases.push_back(Phase(line.substr(1, line.size() - 2)));
+      for (const std::string &key : default_keys)
+        phases.back().set(key, defaults.get_string(key, ""));
+      phases.back().set_inherited(default_keys);
+      continue;
+    }
+
+    std::pair<std::string, std::string> arg = parse_arg(line);
+    if (arg.first.empty())
+      throw IOException("Invalid line " + std::to_string(line_no) + " of " +
+                        path + ", expected key=value");
+    if (phases.empty()) {
+      defaults.set(arg.first, arg.second);
+      default_keys.insert(arg.first);
+    } else {
+      phases.back().set(arg.first, arg.second);
+    }
+  }
+  if (phases.empty()) throw IOException("No phase in job file " + path);
+  return phases;
+}
+
+}  // namespace tps
+
+#endif  // JOB_HPP
@@ -0,0 +1,246 @@
+#ifndef LIVE_STATS_HPP
+#define LIVE_STATS_HPP
+
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "helper.hpp"
+#include "timer.hpp"
+
+namespace tps {
+
+// Latency histogram with 8 linear sub-buckets per power of two, values
+// below 16 ns get a bucket each. The error of a bucket is under 12.5%.
+class LatencyBuckets {
+ public:
+  static constexpr int NUM_BUCKETS = 16 + 60 * 8;
+
+  static int index(uint64_t ns) {
+    if (ns < 16) return static_cast<int>(ns);
+    int e = 63 - __builtin_clzll(ns);
+    int m = static_cast<int>((ns >> (e - 3)) & 7);
+    return 16 + (e - 4) * 8 + m;
+  }
+
+  // Lowest value that falls into bucket idx
+  static uint64_t lower(int idx) {
+    if (idx < 16) return static_cast<uint64_t>(idx);
+    int e = (idx - 16) / 8 + 4;
+    uint64_t m = static_cast<uint64_t>((idx - 16) % 8);
+    return (8 + m) << (e - 3);
+  }
+
+  // Lower bound of the bucket that holds the p-th fraction of counts
+  static uint64_t percentile(const uint64_t *counts, double p) {
+    uint64_t total = 0;
+    for (int b = 0; b < NUM_BUCKETS; b++) total += counts[b];
+    if (total == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(ceil(p * total));
+    uint64_t seen = 0;
+    for (int b = 0; b < NUM_BUCKETS; b++) {
+      seen += counts[b];
+      if (seen >= rank) return lower(b);
+    }
+    return lower(NUM_BUCKETS - 1);
+  }
+};
+
+// Counters of one worker thread on a cache line of its own. Only the owner
+// writes them, so a relaxed store of the running total is enough and the
+// reporter reads them without locking. warmup_latency holds the histogram
+// as it was when the worker left warm-up.
+struct alignas(64) LiveSlot {
+  std::atomic<uint64_t> ops;
+  std::atomic<uint64_t> bytes;
+  std::atomic<uint64_t> latency[LatencyBuckets::NUM_BUCKETS];
+  std::atomic<uint64_t> warmup_latency[LatencyBuckets::NUM_BUCKETS];
+
+  LiveSlot() : ops(0), bytes(0) {
+    for (auto &c : latency) c.store(0, std::memory_order_relaxed);
+    for (auto &c : warmup_latency) c.store(0, std::memory_order_relaxed);
+  }
+};
+
+// Worker side view of a slot that keeps the totals in plain locals
+class LiveCounter {
+ public:
+  explicit LiveCounter(LiveSlot *slot) : slot_(slot), ops_(0), bytes_(0) {
+    for (auto &c : latency_) c = 0;
+  }
+
+  void add_bytes(uint64_t bytes) {
+    bytes_ += bytes;
+    slot_->bytes.store(bytes_, std::memory_order_relaxed);
+  }
+
+  void add_op(uint64_t latency_ns) {
+    int idx = LatencyBuckets::index(latency_ns);
+    slot_->latency[idx].store(++latency_[idx], std::memory_order_relaxed);
+    slot_->ops.store(++ops_, std::memory_order_relaxed);
+  }
+
+  // The ops so far are warm-up, they are left out of the run's histogram
+  void end_warmup() {
+    for (int b = 0; b < LatencyBuckets::NUM_BUCKETS; b++)
+      slot_->warmup_latency[b].store(latency_[b], std::memory_order_relaxed);
+  }
+
+ private:
+  LiveSlot *slot_;
+  uint64_t ops_;
+  uint64_t bytes_;
+  uint64_t latency_[LatencyBuckets::NUM_BUCKETS];
+};
+
+// Samples the slots of all workers every interval and prints the ops,
+// throughput and latency percentiles of the interval.
+class LiveStats {
+ public:
+  explicit LiveStats(int num_slots)
+      : slots_(nullptr),
+        num_slots_(std::max(1, num_slots)),
+        interval_(0),
+        out_(&std::cout),
+        stop_(false) {
+    // operator new only honors alignas(64) from C++17 on
+    void *mem;
+    if (posix_memalign(&mem, 64, num_slots_ * sizeof(LiveSlot)) != 0)
+      throw std::bad_alloc();
+    slots_ = static_cast<LiveSlot *>(mem);
+    for (int i = 0; i < num_slots_; i++) new (&slots_[i]) LiveSlot();
+  }
+
+  ~LiveStats() {
+    stop();
+    for (int i = 0; i < num_slots_; i++) slots_[i].~LiveSlot();
+    free(slots_);
+  }
+
+  LiveStats(const LiveStats &) = delete;
+  LiveStats &operator=(const LiveStats &) = delete;
+
+  LiveSlot *slot(int i) { return &slots_[i]; }
+
+  // Operations and bytes of all workers so far
+  void totals(uint64_t *ops, uint64_t *bytes) const {
+    *ops = 0;
+    *bytes = 0;
+    for (int i = 0; i < num_slots_; i++) {
+      *ops += slots_[i].ops.load(std::memory_order_relaxed);
+      *bytes += slots_[i].bytes.load(std::memory_order_relaxed);
+    }
+  }
+
+  // Latency histogram of all workers so far, without their warm-up
+  void latency_counts(uint64_t *counts) const {
+    for (int b = 0; b < LatencyBuckets::NUM_BUCKETS; b++) counts[b] = 0;
+    for (int i = 0; i < num_slots_; i++) {
+      for (int b = 0; b < LatencyBuckets::NUM_BUCKETS; b++)
+        counts[b] +=
+            slots_[i].latency[b].load(std::memory_order_relaxed) -
+            slots_[i].warmup_latency[b].load(std::memory_order_relaxed);
+    }
+  }
+
+  // Start the reporter, an interval of 0 reports nothing. The prefix goes
+  // in front of every line.
+  void start(long long interval_ns, std::ostream *out,
+             const std::string &prefix) {
+    interval_ = interval_ns;
+    out_ = out;
+    prefix_ = prefix;
+    if (interval_ <= 0) return;
+    stop_ = false;
+    reporter_ = std::thread(&LiveStats::report, this);
+  }
+
+  void stop() {
+    if (!reporter_.joinable()) return;
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    reporter_.join();
+  }
+
+ private:
+  void sample(uint64_t *ops, uint64_t *bytes, uint64_t *latency) const {
+    *ops = 0;
+    *bytes = 0;
+    for (int b = 0; b < LatencyBuckets::NUM_BUCKETS; b++) latency[b] = 0;
+    for (int i = 0; i < num_slots_; i++) {
+      *ops += slots_[i].ops.load(std::memory_order_relaxed);
+      *bytes += slots_[i].bytes.load(std::memory_order_relaxed);
+      for (int b = 0; b < LatencyBuckets::NUM_BUCKETS; b++)
+        latency[b] += slots_[i].latency[b].load(std::memory_order_relaxed);
+    }
+  }
+
+  void report() {
+    std::vector<uint64_t> prev(LatencyBuckets::NUM_BUCKETS, 0);
+    std::vector<uint64_t> cur(LatencyBuckets::NUM_BUCKETS, 0);
+    std::vector<uint64_t> diff(LatencyBuckets::NUM_BUCKETS, 0);
+    uint64_t prev_ops = 0, prev_bytes = 0;
+    HighResTimer timer;
+    timer.start();
+    long long prev_ns = 0;
+    auto next = std::chrono::steady_clock::now();
+    for (size_t n = 1;; n++) {
+      next += std::chrono::nanoseconds(interval_);
+      {
+        std::unique_lock<std::mutex> lock(mtx_);
+        if (cv_.wait_until(lock, next, [this] { return stop_; })) break;
+      }
+      timer.stop();
+      long long now_ns = timer.elapsed_ns();
+      uint64_t ops, bytes;
+      sample(&ops, &bytes, cur.data());
+      for (int b = 0; b < LatencyBuckets::NUM_BUCKETS; b++)
+        diff[b] = cur[b] - prev[b];
+      uint64_t d_ops = ops - prev_ops;
+      uint64_t d_bytes = bytes - prev_bytes;
+      long long d_ns = now_ns - prev_ns;
+
+      const uint64_t *lat = diff.data();
+      *out_ << prefix_ << "interval: " << n << ", elapsed: " << now_ns / 1000000
+            << " ms, operations: " << d_ops
+            << ", throughput: " << to_bytes_per_sec(d_bytes, d_ns)
+            << " bytes/sec, " << to_bytes_per_sec(d_ops, d_ns)
+            << " ops/sec, p50: " << LatencyBuckets::percentile(lat, 0.5)
+            << " ns, p99: " << LatencyBuckets::percentile(lat, 0.99)
+            << " ns, p99.9: " << LatencyBuckets::percentile(lat, 0.999)
+            << " ns" << std::endl;
+
+      prev.swap(cur);
+      prev_ops = ops;
+      prev_bytes = bytes;
+      prev_ns = now_ns;
+    }
+  }
+
+  LiveSlot *slots_;
+  int num_slots_;
+  long long interval_;
+  std::ostream *out_;
+  std::string prefix_;
+  std::thread reporter_;
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  bool stop_;
+};
+
+}  // namespace tps
+
+#endif  // LIVE_STATS_HPP
@@ -0,0 +1,726 @@
+#include <atomic>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "balloon.hpp"
+#include "buffer.hpp"
+#include "cache.hpp"
+#include "compute.hpp"
+#include "cpu_usage.hpp"
+#include "disk_io.hpp"
+#include "file_list.hpp"
+#include "file_lookup.hpp"
+#include "file_replay.hpp"
+#include "file_scan.hpp"
+#include "file_write.hpp"
+#include "helper.hpp"
+#include "io_engine.hpp"
+#include "io_exception.hpp"
+#include "io_priority.hpp"
+#include "job.hpp"
+#include "timer.hpp"
+#include "warmup.hpp"
+
+// Runs the phases of a job file in one process, so later phases see the
+// page cache and the files left by earlier ones.
+
+struct PhaseResult {
+  std::string name;
+  std::string type;
+  size_t ops;
+  size_t bytes;
+  long long time;
+};
+
+static const std::locale &result_locale() {
+  static std::locale locale("en_US.UTF-8");
+  return locale;
+}
+
+static void print_result(const PhaseResult &r) {
+  std::cout << "phase: " << r.name << ", type: " << r.type
+            << ", operations: " << r.ops << ", time: " << r.time
+            << " ns, size: " << r.bytes << " bytes, throughput: "
+            << tps::to_bytes_per_sec(r.bytes, r.time) << " bytes/sec"
+            << std::endl;
+}
+
+// Keys shared by the read phases, the worker keys only by lookups and scans
+struct ReadArgs {
+  std::string dir;
+  size_t record_size;
+  bool buffered;
+  long long max_time;
+  tps::HugePages huge_pages;
+  tps::Engine engine;
+  long long interval;
+  long long warmup_time;
+  size_t warmup_ops;
+  double steady_cv;
+  bool counters;
+  tps::CacheMode cache;
+  size_t mem_limit;
+  tps::Placement placement;
+  std::string trace;
+  size_t rate_limit;
+  tps::IoPriority io_priority;
+};
+
+static ReadArgs get_read_args(tps::Phase &phase,
+                              long long max_time = 10LL * 1000 * 1000 * 1000) {
+  ReadArgs args;
+  args.dir = phase.get_string("dir", "");
+  args.record_size = phase.get_size("record-size", 4096);
+  args.buffered = phase.get_bool("buffered", true);
+  args.max_time = phase.get_time("max-time", max_time);
+  args.huge_pages = tps::HugePages::OFF;
+  if (!tps::parse_huge_pages(phase.get_string("hugepages", "off"),
+                             &args.huge_pages))
+    throw tps::IOException("Value of 'hugepages' in phase '" + phase.name() +
+                           "' is invalid. Valid values are "
+                           "{off, thp, hugetlb}.");
+  args.engine = tps::Engine::READ;
+  if (!tps::parse_engine(phase.get_string("engine", "read"), &args.engine))
+    throw tps::IOException("Value of 'engine' in phase '" + phase.name() +
+                           "' is invalid. Valid values are "
+                           "{read, pread, preadv, mmap, splice, sendfile, "
+                           "uring}.");
+  args.interval = phase.get_time("interval", 0);
+  args.counters = phase.get_bool("counters", false);
+  args.mem_limit = phase.get_size("mem-limit", 0);
+  args.cache = tps::CacheMode::AS_IS;
+  if (!tps::parse_cache_mode(phase.get_string("cache", "as-is"), &args.cache))
+    throw tps::IOException("Value of 'cache' in phase '" + phase.name() +
+                           "' is invalid. Valid values are "
+                           "{cold, warm, as-is}.");
+  args.trace = phase.get_string("trace", "");
+  if (args.engine == tps::Engine::MMAP && !args.buffered)
+    throw tps::IOException("Engine 'mmap' reads through the page cache, it "
+                           "cannot be combined with 'buffered=false'.");
+  args.warmup_time = 0;
+  args.warmup_ops = 0;
+  args.steady_cv = 0.0;
+  args.placement = tps::Placement::GLOBAL;
+  args.rate_limit = 0;
+  return args;
+}
+
+// Keys a replay has no use for, it issues the recorded reads as they are.
+// Left unparsed they are reported by check_unused.
+static void get_worker_args(tps::Phase &phase, ReadArgs *args) {
+  if (!tps::parse_warmup(phase.get_string("warmup", "0"), &args->warmup_time,
+                         &args->warmup_ops))
+    throw tps::IOException("Value of 'warmup' in phase '" + phase.name() +
+                           "' is invalid. Valid values are a time or a "
+                           "number of operations, e.g. 5s or 1000ops.");
+  args->steady_cv = std::max(0.0, phase.get_double("steady", 0.0));
+  if (!tps::parse_placement(phase.get_string("placement", "global"),
+                            &args->placement))
+    throw tps::IOException("Value of 'placement' in phase '" + phase.name() +
+                           "' is invalid. Valid values are "
+                           "{global, per-dir}.");
+  args->rate_limit = phase.get_size("rate", 0);
+  if (!tps::parse_io_priority(phase.get_string("ioprio", "none"),
+                              &args->io_priority))
+    throw tps::IOException("Value of 'ioprio' in phase '" + phase.name() +
+                           "' is invalid. Valid values are "
+                           "{none, idle, be/0..7, rt/0..7}.");
+}
+
+static std::unique_ptr<tps::FileLookup> make_lookup(const ReadArgs &args,
+                                                    int num_threads) {
+  std::unique_ptr<tps::FileLookup> fl(
+      new tps::FileLookup(args.dir, args.record_size, args.max_time,
+                          args.buffered, num_threads));
+  fl->set_huge_pages(args.huge_pages);
+  fl->set_engine(args.engine, 0, 1);
+  fl->set_interval(args.interval);
+  fl->set_warmup(args.warmup_time, args.warmup_ops, args.steady_cv);
+  fl->set_counters(args.counters);
+  fl->set_cache(args.cache);
+  fl->set_mem_limit(args.mem_limit);
+  fl->set_placement(args.placement);
+  fl->set_trace(args.trace);
+  fl->set_rate_limit(args.rate_limit);
+  fl->set_io_priority(args.io_priority);
+  return fl;
+}
+
+static std::unique_ptr<tps::FileScan> make_scan(tps::Phase &phase,
+                                                const ReadArgs &args,
+                                                int num_threads) {
+  tps::Bounds ex_bounds = phase.get_bounds("file-ratio", false);
+  tps::Bounds in_bounds = phase.get_bounds("size-ratio", true);
+  bool seq_file = phase.get_bool("seq-file", true);
+  bool seq_scan = phase.get_bool("seq-scan", true);
+  bool full_middle = phase.get_bool("full-middle", false);
+
+  tps::Compute::Kernel kernel = tps::Compute::NONE;
+  if (!tps::Compute::parse_kernel(phase.get_string("compute", "none"),
+                                  &kernel))
+    throw tps::IOException("Value of 'compute' in phase '" + phase.name() +
+                           "' is invalid. Valid values are "
+                           "{none, sum, minmax, count, hash}.");
+  size_t column_width = phase.get_size("column-width", 8);
+  if (column_width != 4 && column_width != 8)
+    throw tps::IOException("Value of 'column-width' in phase '" +
+                           phase.name() +
+                           "' is invalid. Valid values are {4, 8}.");
+  double selectivity = phase.get_double("selectivity", 0.5);
+  tps::Compute::Isa isa = tps::Compute::AUTO;
+  if (!tps::Compute::parse_isa(phase.get_string("simd", "auto"), &isa))
+    throw tps::IOException("Value of 'simd' in phase '" + phase.name() +
+                           "' is invalid. Valid values are "
+                           "{auto, scalar, avx2, avx512}.");
+
+  // A lookup reads one record per operation, only scans read in chunks
+  size_t chunk_size = phase.get_size("chunk-size", 0);
+  size_t depth = std::max<size_t>(1, phase.get_count("depth", 1));
+  bool pipeline = phase.get_bool("pipeline", false);
+  int num_consumers = std::max(1, phase.get_int("consumers", 1));
+  size_t ring_depth = std::max<size_t>(1, phase.get_count("ring-depth", 8));
+  size_t buffer_size = phase.get_size("buffer-size", 0);
+
+  if (!tps::engine_has_data(args.engine) && kernel != tps::Compute::NONE)
+    throw tps::IOException("Engine '" + tps::engine_name(args.engine) +
+                           "' never copies data to user space, it cannot be "
+                           "combined with 'compute'.");
+  if (!tps::engine_copies(args.engine) && pipeline)
+    throw tps::IOException("Engine '" + tps::engine_name(args.engine) +
+                           "' cannot be combined with 'pipeline'.");
+
+  std::unique_ptr<tps::FileScan> fs(new tps::FileScan(
+      args.dir, args.record_size, args.max_time, args.buffered, num_threads,
+      ex_bounds, in_bounds, seq_file, seq_scan, full_middle));
+  fs->set_compute(tps::Compute(kernel, column_width, selectivity, isa));
+  if (pipeline) fs->set_pipeline(num_consumers, ring_depth, buffer_size);
+  fs->set_engine(args.engine, chunk_size, depth);
+  fs->set_huge_pages(args.huge_pages);
+  fs->set_interval(args.interval);
+  fs->set_warmup(args.warmup_time, args.warmup_ops, args.steady_cv);
+  fs->set_counters(args.counters);
+  fs->set_cache(args.cache);
+  fs->set_mem_limit(args.mem_limit);
+  fs->set_placement(args.placement);
+  fs->set_trace(args.trace);
+  fs->set_rate_limit(args.rate_limit);
+  fs->set_io_priority(args.io_priority);
+  return fs;
+}
+
+// Readers of a mixed phase or of a group share one disk I/O report
+static void print_lookup(const tps::FileLookup &fl, bool disk_io) {
+  if (fl.has_warmup()) fl.print_warmup(std::cout);
+  std::cout << "operations: " << fl.total_ops() << std::endl;
+  std::cout << "total time: " << fl.total_time() << " ns" << std::endl;
+  std::cout << "total size: " << fl.total_bytes() << " bytes" << std::endl;
+  std::cout << "throughput: "
+            << tps::to_bytes_per_sec(fl.total_bytes(), fl.total_time())
+            << " bytes/sec, "
+            << tps::to_bytes_per_sec(fl.total_records(), fl.total_time())
+            << " records/sec" << std::endl;
+  fl.print_dir_results(std::cout);
+  tps::print_cache_residency(std::cout, fl.cache_before(), fl.cache_after());
+  if (disk_io)
+    tps::print_disk_io(std::cout, fl.disk_io(), fl.logical_bytes(), 0);
+  if (fl.has_mem_limit())
+    tps::print_balloon(std::cout, fl.balloon().bytes(), fl.balloon().locked(),
+                       fl.balloon().budget());
+  tps::print_cpu_usage(std::cout, fl.cpu_usage(), fl.total_ops(),
+                       fl.total_bytes());
+  tps::print_perf_counts(std::cout, fl.perf_counts(), fl.total_ops(),
+                         fl.total_bytes());
+}
+
+static void print_scan(const tps::FileScan &fs, bool disk_io) {
+  if (fs.has_warmup()) fs.print_warmup(std::cout);
+  std::cout << "operations: " << fs.total_ops() << std::endl;
+  std::cout << "total time: " << fs.total_time() << " ns" << std::endl;
+  std::cout << "total size: " << fs.total_bytes() << " bytes" << std::endl;
+  std::cout << "total files: " << fs.total_files() << std::endl;
+  std::cout << "throughput: "
+            << tps::to_bytes_per_sec(fs.total_bytes(), fs.total_time())
+            << " bytes/sec, "
+            << tps::to_bytes_per_sec(fs.total_records(), fs.total_time())
+            << " records/sec" << std::endl;
+  fs.print_dir_results(std::cout);
+  tps::print_cache_residency(std::cout, fs.cache_before(), fs.cache_after());
+  if (disk_io)
+    tps::print_disk_io(std::cout, fs.disk_io(), fs.logical_bytes(), 0);
+  if (fs.has_mem_limit())
+    tps::print_balloon(std::cout, fs.balloon().bytes(), fs.balloon().locked(),
+                       fs.balloon().budget());
+  tps::print_cpu_usage(std::cout, fs.cpu_usage(), fs.total_ops(),
+                       fs.total_bytes());
+  tps::print_perf_counts(std::cout, fs.perf_counts(), fs.total_ops(),
+                         fs.total_bytes());
+  if (fs.compute().kernel() != tps::Compute::NONE)
+    std::cout << "compute result: " << fs.compute().result() << std::endl;
+}
+
+static void run_load(tps::Phase &phase, std::vector<PhaseResult> *results) {
+  std::string dir = phase.get_string("dir", "");
+  size_t total_size = phase.get_size("total-size", 0);
+  size_t file_size = phase.get_size("file-size", 0);
+  bool sequential = phase.get_bool("sequential", true);
+  bool counters = phase.get_bool("counters", false);
+  bool manifest = phase.get_bool("manifest", false);
+  tps::Stripe stripe = tps::Stripe::ROUND_ROBIN;
+  if (!tps::parse_stripe(phase.get_string("stripe", "round-robin"), &stripe))
+    throw tps::IOException("Value of 'stripe' in phase '" + phase.name() +
+                           "' is invalid. Valid values are "
+                           "{round-robin, capacity}.");
+  tps::HugePages huge_pages = tps::HugePages::OFF;
+  if (!tps::parse_huge_pages(phase.get_string("hugepages", "off"),
+                             &huge_pages))
+    throw tps::IOException("Value of 'hugepages' in phase '" + phase.name() +
+                           "' is invalid. Valid values are "
+                           "{off, thp, hugetlb}.");
+  phase.check_unused();
+
+  tps::FileWrite fw(dir, total_size, file_size, sequential);
+  fw.set_huge_pages(huge_pages);
+  fw.set_counters(counters);
+  fw.set_manifest(manifest);
+  fw.set_stripe(stripe);
+  fw.print_arguments();
+  std::unordered_map<std::string, long long> elapsed = fw.write();
+  long long total_time = 0;
+  for (const auto &e : elapsed) total_time += e.second;
+
+  PhaseResult r = {phase.name(), "load", elapsed.size(), total_size,
+                   total_time};
+  std::cout.imbue(result_locale());
+  tps::print_disk_io(std::cout, fw.disk_io(), 0, r.bytes);
+  tps::print_cpu_usage(std::cout, fw.cpu_usage(), r.ops, r.bytes);
+  tps::print_perf_counts(std::cout, fw.perf_counts(), r.ops, r.bytes);
+  print_result(r);
+  results->push_back(r);
+}
+
+// Read every file once through the page cache
+static void run_warm(tps::Phase &phase, std::vector<PhaseResult> *results) {
+  std::string dir = phase.get_string("dir", "");
+  int num_threads = std::max(1, phase.get_int("threads", 1));
+  size_t chunk_size = phase.get_size("chunk-size", 1024 * 1024);
+  phase.check_unused();
+
+  std::shared_ptr<const tps::FileList> list = tps::FileList::load(dir);
+  const std::vector<std::string> &files = list->files;
+  std::vector<int> dir_fds;
+  for (const std::string &d : list->dirs) {
+    int fd = open(d.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd == -1) {
+      int err = errno;
+      for (int f : dir_fds) close(f);
+      throw tps::IOException("Failed to open " + d + ", error " +
+                             std::to_string(err));
+    }
+    dir_fds.push_back(fd);
+  }
+
+  std::cout << "# dir = " << dir << std::endl;
+  std::cout << "# threads = " << num_threads << std::endl;
+  std::cout << "# chunk-size = " << chunk_size << std::endl;
+
+  tps::EngineConfig config;
+  config.chunk_size = chunk_size;
+  config.record_size = chunk_size;
+  config.max_targets = 1;
+  config.depth = 1;
+  config.io_align = 0;
+  config.buffered = true;
+  config.own_buffer = true;
+  config.huge_pages = tps::HugePages::OFF;
+  config.mem_align = 0;
+
+  std::atomic<size_t> next(0);
+  std::atomic<size_t> total_bytes(0);
+  std::mutex mtx;
+  tps::CpuUsage usage;
+  auto warm = [&]() {
+    tps::ReadEngine engine(config);
+    tps::CpuUsage usage_start = tps::CpuUsage::thread();
+    size_t bytes = 0;
+    for (size_t i = next++; i < files.size(); i = next++) {
+      int t = engine.open(dir_fds[list->file_dirs[i]], files[i].c_str(), 0);
+      if (t == -1) continue;
+      const char *data;
+      size_t n;
+      while ((n = engine.reap(t, nullptr, &data)) != 0 &&
+             n != tps::EngineBase::IO_ERROR)
+        bytes += n;
+      engine.close(t);
+    }
+    total_bytes += bytes;
+    const std::lock_guard<std::mutex> lock(mtx);
+    usage += tps::CpuUsage::thread() - usage_start;
+  };
+
+  tps::HighResTimer timer;
+  timer.start();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; i++) threads.emplace_back(warm);
+  for (std::thread &t : threads) t.join();
+  timer.stop();
+  for (int fd : dir_fds) close(fd);
+
+  PhaseResult r = {phase.name(), "warm", files.size(), total_bytes.load(),
+                   timer.elapsed_ns()};
+  std::cout.imbue(result_locale());
+  tps::print_cpu_usage(std::cout, usage, r.ops, r.bytes);
+  print_result(r);
+  results->push_back(r);
+}
+
+static void run_lookup(tps::Phase &phase, std::vector<PhaseResult> *results) {
+  ReadArgs args = get_read_args(phase);
+  get_worker_args(phase, &args);
+  int num_threads = std::max(1, phase.get_int("threads", 1));
+  int num_procs = std::max(1, phase.get_int("procs", 1));
+  phase.check_unused();
+
+  std::unique_ptr<tps::FileLookup> fl = make_lookup(args, num_threads);
+  fl->set_procs(num_procs);
+  fl->print_arguments();
+  fl->start_read();
+  std::cout.imbue(result_locale());
+  print_lookup(*fl, true);
+  results->push_back({phase.name(), "lookup", fl->total_ops(),
+                      fl->total_bytes(), fl->total_time()});
+}
+
+static void run_scan(tps::Phase &phase, std::vector<PhaseResult> *results) {
+  ReadArgs args = get_read_args(phase);
+  get_worker_args(phase, &args);
+  int num_threads = std::max(1, phase.get_int("threads", 1));
+  int num_procs = std::max(1, phase.get_int("procs", 1));
+  std::unique_ptr<tps::FileScan> fs = make_scan(phase, args, num_threads);
+  fs->set_procs(num_procs);
+  phase.check_unused();
+
+  fs->print_arguments();
+  fs->start_read();
+  std::cout.imbue(result_locale());
+  print_scan(*fs, true);
+  results->push_back({phase.name(), "scan", fs->total_ops(),
+                      fs->total_bytes(), fs->total_time()});
+}
+
+// Lookups and scans over the same files at the same time
+static void run_mixed(tps::Phase &phase, std::vector<PhaseResult> *results) {
+  ReadArgs args = get_read_args(phase);
+  get_worker_args(phase, &args);
+  int lookup_threads = std::max(1, phase.get_int("lookup-threads", 1));
+  int scan_threads = std::max(1, phase.get_int("scan-threads", 1));
+  ReadArgs lookup_args = args;
+  lookup_args.record_size =
+      phase.get_size("lookup-record-size", args.record_size);
+  std::unique_ptr<tps::FileScan> fs = make_scan(phase, args, scan_threads);
+  phase.check_unused();
+  if (!args.trace.empty())
+    throw tps::IOException("Phase '" + phase.name() + "' is mixed, 'trace' "
+                           "records a lookup or a scan phase.");
+  if (args.cache != tps::CacheMode::AS_IS || args.mem_limit > 0)
+    throw tps::IOException("Phase '" + phase.name() + "' is mixed, 'cache' "
+                           "and 'mem-limit' would change the page cache "
+                           "under the reader that started first.");
+
+  std::unique_ptr<tps::FileLookup> fl = make_lookup(lookup_args,
+                                                    lookup_threads);
+  std::cout << "# lookup-threads = " << lookup_threads << std::endl;
+  std::cout << "# lookup-record-size = " << lookup_args.record_size
+            << std::endl;
+  fs->print_arguments();
+
+  // Disk I/O of the two cannot be told apart, it is measured around both
+  tps::DiskIo disk_io(fs->dirs());
+
+  // Both are joined before a failure of either is reported
+  disk_io.begin();
+  std::exception_ptr lookup_error;
+  std::thread lookup([&]() {
+    try {
+      fl->start_read();
+    } catch (...) {
+      lookup_error = std::current_exception();
+    }
+  });
+  std::exception_ptr scan_error;
+  try {
+    fs->start_read();
+  } catch (...) {
+    scan_error = std::current_exception();
+  }
+  lookup.join();
+  disk_io.end();
+  if (lookup_error) std::rethrow_exception(lookup_error);
+  if (scan_error) std::rethrow_exception(scan_error);
+
+  std::cout.imbue(result_locale());
+  std::cout << "lookup" << std::endl;
+  print_lookup(*fl, false);
+  std::cout << "scan" << std::endl;
+  print_scan(*fs, false);
+  tps::print_disk_io(std::cout, disk_io,
+                     fl->logical_bytes() + fs->logical_bytes(), 0);
+  results->push_back({phase.name() + "/lookup", "mixed", fl->total_ops(),
+                      fl->total_bytes(), fl->total_time()});
+  results->push_back({phase.name() + "/scan", "mixed", fs->total_ops(),
+                      fs->total_bytes(), fs->total_time()});
+}
+
+static void print_latency(const tps::FileRead &fr) {
+  std::cout << "latency: p50: " << fr.latency(0.5)
+            << " ns, p99: " << fr.latency(0.99)
+            << " ns, p99.9: " << fr.latency(0.999) << " ns" << std::endl;
+}
+
+// Consecutive lookup and scan phases with the same group run at the same
+// time as the classes of one workload, e.g. latency-critical lookups next
+// to background scans. Every class keeps its own keys, rate and ioprio and
+// reports its own throughput and latency. The page cache is left as it is
+// and disk I/O is measured once around all classes, a class cannot tell
+// its own I/O from that of the others.
+static void run_group(const std::string &group,
+                      const std::vector<tps::Phase *> &classes,
+                      std::vector<PhaseResult> *results) {
+  std::vector<std::unique_ptr<tps::FileRead>> readers;
+  std::vector<std::string> types;
+  for (tps::Phase *phase : classes) {
+    std::string type = tps::to_lower(phase->get_string("type", ""));
+    phase->get_string("group", "");
+    ReadArgs args = get_read_args(*phase);
+    get_worker_args(*phase, &args);
+    int num_threads = std::max(1, phase->get_int("threads", 1));
+    int num_procs = std::max(1, phase->get_int("procs", 1));
+    // Forking while the other classes' threads run could leave a child with
+    // a lock one of them held
+    if (num_procs > 1)
+      throw tps::IOException("Phase '" + phase->name() + "' is in group '" +
+                             group + "', its classes run as threads of one "
+                             "process, 'procs' cannot be more than 1.");
+    if (type.compare("lookup") == 0) {
+      readers.emplace_back(make_lookup(args, num_threads).release());
+    } else if (type.compare("scan") == 0) {
+      readers.emplace_back(make_scan(*phase, args, num_threads).release());
+    } else {
+      throw tps::IOException("Phase '" + phase->name() + "' is in group '" +
+                             group + "', only lookup and scan phases run "
+                             "as classes.");
+    }
+    phase->check_unused();
+    if (!args.trace.empty())
+      throw tps::IOException("Phase '" + phase->name() + "' is in group '" +
+                             group + "', 'trace' records a lookup or a scan "
+                             "phase.");
+    if (args.cache != tps::CacheMode::AS_IS || args.mem_limit > 0)
+      throw tps::IOException("Phase '" + phase->name() + "' is in group '" +
+                             group + "', 'cache' and 'mem-limit' would "
+                             "change the page cache under the other "
+                             "classes.");
+    readers.back()->set_record_latency(true);
+    types.push_back(type);
+    std::cout << "## class = " << phase->name() << std::endl;
+    std::cout << "# type = " << type << std::endl;
+    readers.back()->print_arguments();
+  }
+
+  std::vector<std::string> dirs;
+  for (const std::unique_ptr<tps::FileRead> &fr : readers)
+    dirs.insert(dirs.end(), fr->dirs().begin(), fr->dirs().end());
+  tps::DiskIo disk_io(dirs);
+
+  // A failed class is reported once all of them are done
+  std::vector<std::exception_ptr> errors(readers.size());
+  disk_io.begin();
+  std::vector<std::thread> threads;
+  for (size_t c = 0; c < readers.size(); c++) {
+    threads.emplace_back([&readers, &errors, c]() {
+      try {
+        readers[c]->start_read();
+      } catch (...) {
+        errors[c] = std::current_exception();
+      }
+    });
+  }
+  for (std::thread &t : threads) t.join();
+  disk_io.end();
+  for (std::exception_ptr &e : errors) {
+    if (e) std::rethrow_exception(e);
+  }
+
+  std::cout.imbue(result_locale());
+  size_t logical_bytes = 0;
+  for (size_t c = 0; c < readers.size(); c++) {
+    const tps::FileRead &fr = *readers[c];
+    std::cout << "class: " << classes[c]->name() << std::endl;
+    if (types[c].compare("lookup") == 0)
+      print_lookup(static_cast<const tps::FileLookup &>(fr), false);
+    else
+      print_scan(static_cast<const tps::FileScan &>(fr), false);
+    print_latency(fr);
+    logical_bytes += fr.logical_bytes();
+    results->push_back({group + "/" + classes[c]->name(), types[c],
+                        fr.total_ops(), fr.total_bytes(), fr.total_time()});
+  }
+  std::cout << "group: " << group << std::endl;
+  tps::print_disk_io(std::cout, disk_io, logical_bytes, 0);
+}
+
+// Re-issue a trace recorded by an earlier phase, the trace key names the
+// file to read instead of one to write
+static void run_replay(tps::Phase &phase, std::vector<PhaseResult> *results) {
+  ReadArgs args = get_read_args(phase, 0);
+  int num_threads = std::max(1, phase.get_int("threads", 1));
+  tps::ReplayTiming timing = tps::ReplayTiming::FAST;
+  if (!tps::parse_replay_timing(phase.get_string("timing", "fast"), &timing))
+    throw tps::IOException("Value of 'timing' in phase '" + phase.name() +
+                           "' is invalid. Valid values are "
+                           "{fast, original}.");
+  phase.check_unused();
+  if (args.trace.empty())
+    throw tps::IOException("Phase '" + phase.name() + "' needs a 'trace'.");
+  if (args.record_size == 0)
+    throw tps::IOException("Phase '" + phase.name() + "' needs a "
+                           "'record-size'.");
+
+  tps::FileReplay fr(tps::Trace::load(args.trace), args.dir,
+                     args.record_size, args.max_time, args.buffered,
+                     num_threads);
+  fr.set_timing(timing);
+  fr.set_huge_pages(args.huge_pages);
+  fr.set_engine(args.engine, 0, 1);
+  fr.set_interval(args.interval);
+  fr.set_counters(args.counters);
+  fr.set_cache(args.cache);
+  fr.set_mem_limit(args.mem_limit);
+  fr.print_arguments();
+  fr.start_read();
+  std::cout.imbue(result_locale());
+  std::cout << "operations: " << fr.total_ops() << std::endl;
+  std::cout << "total time: " << fr.total_time() << " ns" << std::endl;
+  std::cout << "total size: " << fr.total_bytes() << " bytes" << std::endl;
+  fr.print_replay(std::cout);
+  fr.print_dir_results(std::cout);
+  tps::print_cache_residency(std::cout, fr.cache_before(), fr.cache_after());
+  tps::print_disk_io(std::cout, fr.disk_io(), fr.logical_bytes(), 0);
+  if (fr.has_mem_limit())
+    tps::print_balloon(std::cout, fr.balloon().bytes(), fr.balloon().locked(),
+                       fr.balloon().budget());
+  tps::print_cpu_usage(std::cout, fr.cpu_usage(), fr.total_ops(),
+                       fr.total_bytes());
+  tps::print_perf_counts(std::cout, fr.perf_counts(), fr.total_ops(),
+                         fr.total_bytes());
+  results->push_back({phase.name(), "replay", fr.total_ops(),
+                      fr.total_bytes(), fr.total_time()});
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cout << "Usage: " << argv[0] << " [key=value]..." << std::endl;
+    std::cout << "  Keys:" << std::endl;
+    std::cout << "    -  job: Path to the job file." << std::endl;
+    std::cout << "  Job file:" << std::endl;
+    std::cout << "    key=value lines grouped in [name] sections, one section "
+                 "per phase."
+              << std::endl;
+    std::cout << "    Keys before the first section apply to every phase."
+              << std::endl;
+    std::cout << "    Each phase sets type={load, warm, lookup, scan, mixed, "
+                 "replay} and the"
+              << std::endl;
+    std::cout << "    keys of file_write (load), file_lookup (lookup), "
+                 "file_scan (scan) or"
+              << std::endl;
+    std::cout << "    file_replay (replay)." << std::endl;
+    std::cout << "    warm reads every file once with threads and "
+                 "chunk-size."
+              << std::endl;
+    std::cout << "    mixed runs a lookup and a scan together with "
+                 "lookup-threads,"
+              << std::endl;
+    std::cout << "    scan-threads, lookup-record-size and the scan keys, "
+                 "and leaves the"
+              << std::endl;
+    std::cout << "    page cache as it is." << std::endl;
+    std::cout << "    Consecutive lookup and scan phases with the same group="
+                 "name run"
+              << std::endl;
+    std::cout << "    at the same time, each with its own keys, rate and "
+                 "ioprio, and"
+              << std::endl;
+    std::cout << "    report their own throughput and latency. Disk I/O is "
+                 "reported for the"
+              << std::endl;
+    std::cout << "    whole group, which leaves the page cache as it is."
+              << std::endl;
+    return 0;
+  }
+
+  std::string job_path;
+  for (int i = 1; i < argc; i++) {
+    std::pair<std::string, std::string> arg = tps::parse_arg(argv[i]);
+    if (arg.first.compare("job") == 0)
+      job_path = arg.second;
+    else {
+      std::cerr << "Invalid key '" << arg.first
+                << "'. Valid keys are {job}." << std::endl;
+      return -1;
+    }
+  }
+
+  std::vector<PhaseResult> results;
+  try {
+    std::vector<tps::Phase> phases = tps::parse_job(job_path);
+    for (size_t i = 0; i < phases.size(); i++) {
+      tps::Phase &phase = phases[i];
+      if (phase.has("group")) {
+        std::string group = phase.get_string("group", "");
+        std::vector<tps::Phase *> classes(1, &phase);
+        while (i + 1 < phases.size() && phases[i + 1].has("group") &&
+               phases[i + 1].get_string("group", "") == group)
+          classes.push_back(&phases[++i]);
+        std::cout.imbue(std::locale::classic());
+        std::cout << "## group = " << group << std::endl;
+        run_group(group, classes, &results);
+        std::cout << std::endl;
+        continue;
+      }
+      std::string type = tps::to_lower(phase.get_string("type", ""));
+      std::cout.imbue(std::locale::classic());
+      std::cout << "## phase = " << phase.name() << std::endl;
+      std::cout << "# type = " << type << std::endl;
+      if (type.compare("load") == 0)
+        run_load(phase, &results);
+      else if (type.compare("warm") == 0)
+        run_warm(phase, &results);
+      else if (type.compare("lookup") == 0)
+        run_lookup(phase, &results);
+      else if (type.compare("scan") == 0)
+        run_scan(phase, &results);
+      else if (type.compare("mixed") == 0)
+        run_mixed(phase, &results);
+      else if (type.compare("replay") == 0)
+        run_replay(phase, &results);
+      else
+        throw tps::IOException("Value of 'type' in phase '" + phase.name() +
+                               "' is invalid. Valid values are "
+                               "{load, warm, lookup, scan, mixed, "
+                               "replay}.");
+      std::cout << std::endl;
+    }
+  } catch (const tps::IOException &e) {
+    std::cerr << e.what() << std::endl;
+    return -1;
+  }
+
+  std::cout.imbue(result_locale());
+  for (const PhaseResult &r : results) print_result(r);
+  return 0;
+}
@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "helper.hpp"
+#include "perf_counter.hpp"
+
+// Measures the CPU the lookup and scan loops spend per operation on picking
+// files and ranges, without doing any I/O. The "old" variants build paths
+// and hash containers per operation, the "new" ones match the current loops.
+
+static volatile size_t sink;
+
+// Cycles and instructions are left out where perf_event_open is refused
+static void report(const std::string &name, size_t ops, long long cpu_ns,
+                   tps::PerfGroup *perf) {
+  perf->stop();
+  const tps::PerfCounts &counts = perf->counts();
+  std::cout << name << ": " << cpu_ns / static_cast<long long>(ops)
+            << " ns/op";
+  if (counts.has(tps::PerfCounts::CYCLES) &&
+      counts.has(tps::PerfCounts::INSTRUCTIONS))
+    std::cout << ", " << counts.get(tps::PerfCounts::CYCLES) / ops
+              << " cycles/op, "
+              << counts.get(tps::PerfCounts::INSTRUCTIONS) / ops
+              << " instructions/op, IPC " << counts.ipc();
+  if (counts.has(tps::PerfCounts::LLC_MISSES))
+    std::cout << ", " << 1.0 * counts.get(tps::PerfCounts::LLC_MISSES) / ops
+              << " LLC misses/op";
+  std::cout << std::endl;
+}
+
+static long long cpu_now() {
+  long long user_ns, sys_ns;
+  tps::get_thread_cpu_time(&user_ns, &sys_ns);
+  return user_ns + sys_ns;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cout << "Usage: " << argv[0] << " [key=value]..." << std::endl;
+    std::cout << "  Keys:" << std::endl;
+    std::cout << "    - files: Number of files in the simulated directory."
+              << std::endl;
+    std::cout << "    - picks: Number of files picked per scan operation."
+              << std::endl;
+    std::cout << "    -   ops: Number of operations to run." << std::endl;
+    return 0;
+  }
+
+  size_t num_files = 10000;
+  size_t num_picks = 16;
+  size_t num_ops = 1000000;
+  for (int i = 1; i < argc; i++) {
+    std::pair<std::string, std::string> arg = tps::parse_arg(argv[i]);
+    if (arg.first.compare("files") == 0)
+      num_files = std::max<size_t>(1, tps::to_size_t(arg.second));
+    else if (arg.first.compare("picks") == 0)
+      num_picks = std::max<size_t>(1, tps::to_size_t(arg.second));
+    else if (arg.first.compare("ops") == 0)
+      num_ops = std::max<size_t>(1, tps::to_size_t(arg.second));
+    else {
+      std::cerr << "Invalid key '" << arg.first
+                << "'. Valid keys are {files, picks, ops}." << std::endl;
+      return -1;
+    }
+  }
+  num_picks = std::min(num_picks, num_files);
+
+  std::string dir = "/data/benchmark/dataset";
+  size_t name_len = std::to_string(num_files - 1).size();
+  std::vector<std::string> files;
+  files.reserve(num_files);
+  for (size_t i = 0; i < num_files; i++) {
+    std::string name = std::to_string(i);
+    while (name.size() < name_len) name = "0" + name;
+    files.push_back(name + ".bin");
+  }
+
+  std::cout << "# files = " << num_files << std::endl;
+  std::cout << "# picks = " << num_picks << std::endl;
+  std::cout << "# ops = " << num_ops << std::endl;
+
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<size_t> file_dist(0, num_files - 1);
+  std::uniform_real_distribution<double> pos_dist(0.0, 1.0);
+
+  tps::PerfGroup perf(true);
+  perf.start();
+  long long start = cpu_now();
+  for (size_t op = 0; op < num_ops; op++) {
+    std::string picked_file = dir + "/" + files[file_dist(gen)];
+    sink = sink + picked_file.size();
+  }
+  report("lookup old", num_ops, cpu_now() - start, &perf);
+
+  perf.start();
+  start = cpu_now();
+  for (size_t op = 0; op < num_ops; op++) {
+    const char *picked_file = files[file_dist(gen)].c_str();
+    sink = sink + static_cast<size_t>(picked_file[0]);
+  }
+  report("lookup new", num_ops, cpu_now() - start, &perf);
+
+  perf.start();
+  start = cpu_now();
+  for (size_t op = 0; op < num_ops; op++) {
+    std::vector<size_t> rand_indexes;
+    std::unordered_set<size_t> uniques;
+    rand_indexes.reserve(num_picks);
+    while (uniques.size() < num_picks) {
+      size_t ridx =
+          static_cast<size_t>(round(pos_dist(gen) * (num_files - 1)));
+      if (uniques.insert(ridx).second) rand_indexes.push_back(ridx);
+    }
+    std::unordered_map<size_t, size_t> positions;
+    std::unordered_map<size_t, size_t> lengths;
+    std::unordered_map<size_t, int> fds;
+    for (size_t fidx : rand_indexes) {
+      positions.insert({fidx, fidx});
+      lengths.insert({fidx, fidx});
+    }
+    for (size_t fidx : rand_indexes) {
+      std::string picked_file = dir + "/" + files[fidx];
+      fds.insert({fidx, static_cast<int>(picked_file.size())});
+    }
+    while (!lengths.empty()) {
+      size_t r =
+          static_cast<size_t>(round(pos_dist(gen) * (lengths.size() - 1)));
+      auto it = std::next(std::begin(lengths), r);
+      sink = sink + fds[it->first] + positions[it->first];
+      lengths.erase(it->first);
+    }
+  }
+  report("scan old", num_ops, cpu_now() - start, &perf);
+
+  std::vector<size_t> picks;
+  picks.reserve(num_picks);
+  std::vector<size_t> positions(num_picks);
+  std::vector<size_t> lengths(num_picks);
+  std::vector<int> fds(num_picks);
+  std::vector<size_t> active(num_picks);
+  std::vector<uint32_t> marks(num_files, 0);
+  uint32_t epoch = 0;
+  perf.start();
+  start = cpu_now();
+  for (size_t op = 0; op < num_ops; op++) {
+    picks.clear();
+    if (++epoch == 0) {
+      std::fill(marks.begin(), marks.end(), 0);
+      epoch = 1;
+    }
+    for (size_t j = num_files - num_picks; j < num_files; j++) {
+      size_t t = std::uniform_int_distribution<size_t>(0, j)(gen);
+      size_t ridx = marks[t] == epoch ? j : t;
+      marks[ridx] = epoch;
+      picks.push_back(ridx);
+    }
+    std::shuffle(picks.begin(), picks.end(), gen);
+    for (size_t i = 0; i < num_picks; i++) {
+      positions[i] = picks[i];
+      lengths[i] = picks[i];
+      fds[i] = static_cast<int>(files[picks[i]].size());
+      active[i] = i;
+    }
+    size_t num_active = num_picks;
+    while (num_active > 0) {
+      size_t r = static_cast<size_t>(round(pos_dist(gen) * (num_active - 1)));
+      size_t i = active[r];
+      sink = sink + fds[i] + positions[i];
+      active[r] = active[--num_active];
+    }
+  }
+  report("scan new", num_ops, cpu_now() - start, &perf);
+
+  return 0;
+}
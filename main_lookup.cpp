@@ -1,40 +1,171 @@
 #include <iostream>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "file_lookup.hpp"
+#include "balloon.hpp"
+#include "buffer.hpp"
+#include "cache.hpp"
+#include "cpu_usage.hpp"
+#include "disk_io.hpp"
 #include "helper.hpp"
+#include "repeat.hpp"
+#include "report.hpp"
+#include "sweep.hpp"
+#include "warmup.hpp"
 
 int main(int argc, char *argv[]) {
-  if (argc != 6) {
+  if (argc < 6) {
     std::cout << "Usage: " << argv[0] << " [key=value]..." << std::endl;
     std::cout << "  Keys:" << std::endl;
     std::cout << "    -         dir: Path to the output directory."
               << std::endl;
-    std::cout << "    - record-size: Record size." << std::endl;
-    std::cout << "                   e.g. 12, 34b, 2kB, 3MB, 4GB" << std::endl;
+    std::cout << "                   dir1,dir2,... reads the files of all the "
+                 "directories."
+              << std::endl;
+    std::cout << "    - record-size: Record size, or a range to sweep."
+              << std::endl;
+    std::cout << "                   e.g. 12, 34b, 2kB, 3MB, 4GB, 4KB..1MB*4"
+              << std::endl;
     std::cout << "    -    max-time: Max running time." << std::endl;
     std::cout << "                   e.g. 300, 10{h, min, s, ms, us, ns}"
               << std::endl;
     std::cout << "    -    buffered: Buffered read." << std::endl;
     std::cout << "                   {true, t, yes, y, 1, false, f, no, n, 0}"
               << std::endl;
-    std::cout << "    -     threads: Number of threads." << std::endl;
+    std::cout << "    -     threads: Number of threads, or a range to sweep."
+              << std::endl;
+    std::cout << "                   e.g. 8, 1,2,6, 1..64 (doubling), 1..64*4, "
+                 "2..8+2"
+              << std::endl;
+    std::cout << "  Optional keys:" << std::endl;
+    std::cout << "    -       procs: Number of worker processes, each runs "
+                 "'threads' threads."
+              << std::endl;
+    std::cout << "                   default 1" << std::endl;
+    std::cout << "    -   hugepages: Huge pages backing the I/O buffers."
+              << std::endl;
+    std::cout << "                   {off, thp, hugetlb}, default off"
+              << std::endl;
+    std::cout << "    -      engine: How file contents are moved." << std::endl;
+    std::cout << "                   {read, pread, preadv, mmap, splice, "
+                 "sendfile, uring},"
+              << std::endl;
+    std::cout << "                   default read" << std::endl;
+    std::cout << "    -    interval: Print throughput and latency every "
+                 "interval while running."
+              << std::endl;
+    std::cout << "                   e.g. 1s, 500ms, default 0 (off)"
+              << std::endl;
+    std::cout << "    -      warmup: Time or operations left out of the "
+                 "results."
+              << std::endl;
+    std::cout << "                   e.g. 5s, 1000ops, default 0 (off)"
+              << std::endl;
+    std::cout << "    -      steady: End warm-up once the coefficient of "
+                 "variation of the"
+              << std::endl;
+    std::cout << "                   last 5 interval throughputs is below it."
+              << std::endl;
+    std::cout << "                   e.g. 0.05, default 0 (off)" << std::endl;
+    std::cout << "    -   placement: Threads read all the directories or are "
+                 "dealt one each."
+              << std::endl;
+    std::cout << "                   {global, per-dir}, default global"
+              << std::endl;
+    std::cout << "    -       cache: Page cache state of the files before "
+                 "each run."
+              << std::endl;
+    std::cout << "                   {cold, warm, as-is}, default as-is"
+              << std::endl;
+    std::cout << "    -   mem-limit: Memory left available to the page cache, "
+                 "the rest is"
+              << std::endl;
+    std::cout << "                   held by a locked balloon during each run."
+              << std::endl;
+    std::cout << "                   e.g. 512MB, 4GB, default 0 (off)"
+              << std::endl;
+    std::cout << "    -        rate: Cap on the bytes read per second by all "
+                 "threads."
+              << std::endl;
+    std::cout << "                   e.g. 100MB, default 0 (off)" << std::endl;
+    std::cout << "    -      ioprio: I/O scheduling class of the threads, "
+                 "honoured by bfq."
+              << std::endl;
+    std::cout << "                   {none, idle, be/0..7, rt/0..7}, default "
+                 "none"
+              << std::endl;
+    std::cout << "    -       trace: Record every read to this file for "
+                 "file_replay."
+              << std::endl;
+    std::cout << "                   Only for a single run with procs=1, "
+                 "records are kept"
+              << std::endl;
+    std::cout << "                   in memory, about 40 bytes per read."
+              << std::endl;
+    std::cout << "    -      repeat: Runs of each point, summarized by mean, "
+                 "stddev and 95% CI."
+              << std::endl;
+    std::cout << "                   With cache=cold the cache is dropped "
+                 "before every run."
+              << std::endl;
+    std::cout << "                   default 1" << std::endl;
+    std::cout << "    -    baseline: Compare with the results saved by "
+                 "save-baseline and flag"
+              << std::endl;
+    std::cout << "                   significant changes, exit status 2 on a "
+                 "regression."
+              << std::endl;
+    std::cout << "    - save-baseline: Save the summaries of the runs to this "
+                 "file."
+              << std::endl;
+    std::cout << "    -      output: Format of the results." << std::endl;
+    std::cout << "                   {text, json, csv}, default text"
+              << std::endl;
+    std::cout << "    -    counters: Count cycles, instructions and LLC misses."
+              << std::endl;
+    std::cout << "                   {true, false}, default false" << std::endl;
     return 0;
   }
 
   std::string dir_path;
-  size_t record_size = 0;
+  std::vector<size_t> record_sizes(1, 0);
   long long max_time = 0;
   bool buffered = true;
-  int num_threads = 1;
+  std::vector<size_t> threads(1, 1);
+  int num_procs = 1;
+  tps::HugePages huge_pages = tps::HugePages::OFF;
+  tps::Engine engine = tps::Engine::READ;
+  tps::Output output = tps::Output::TEXT;
+  tps::CacheMode cache = tps::CacheMode::AS_IS;
+  tps::Placement placement = tps::Placement::GLOBAL;
+  size_t mem_limit = 0;
+  size_t rate_limit = 0;
+  tps::IoPriority io_priority;
+  std::string trace_path;
+  int repeat = 1;
+  std::string baseline_path;
+  std::string save_path;
+  bool counters = false;
+  long long interval = 0;
+  long long warmup_time = 0;
+  size_t warmup_ops = 0;
+  double steady_cv = 0.0;
 
   for (int i = 1; i < argc; i++) {
     std::pair<std::string, std::string> arg = tps::parse_arg(argv[i]);
     if (arg.first.compare("dir") == 0)
       dir_path = arg.second;
-    else if (arg.first.compare("record-size") == 0)
-      record_size = tps::size_in_bytes(arg.second);
-    else if (arg.first.compare("max-time") == 0)
+    else if (arg.first.compare("record-size") == 0) {
+      if (!tps::parse_range(arg.second, true, &record_sizes)) {
+        std::cerr << "Value of 'record-size' is invalid. Valid values are a "
+                     "size, a list or a range, e.g. 4KB, 4KB,1MB or "
+                     "4KB..1MB*4."
+                  << std::endl;
+        return -1;
+      }
+    } else if (arg.first.compare("max-time") == 0)
       max_time = std::max(0LL, tps::time_in_ns(arg.second));
     else if (arg.first.compare("buffered") == 0) {
       std::string value = tps::to_upper(arg.second);
@@ -52,29 +183,276 @@ int main(int argc, char *argv[]) {
                   << std::endl;
         return -1;
       }
-    } else if (arg.first.compare("threads") == 0)
-      num_threads = std::max(1, std::stoi(arg.second));
+    } else if (arg.first.compare("threads") == 0) {
+      if (!tps::parse_range(arg.second, false, &threads) || threads[0] == 0) {
+        std::cerr << "Value of 'threads' is invalid. Valid values are a "
+                     "number, a list or a range, e.g. 8, 1,2,6 or 1..64*2."
+                  << std::endl;
+        return -1;
+      }
+    } else if (arg.first.compare("procs") == 0)
+      num_procs = std::max(1, std::stoi(arg.second));
+    else if (arg.first.compare("hugepages") == 0) {
+      if (!tps::parse_huge_pages(arg.second, &huge_pages)) {
+        std::cerr << "Value of 'hugepages' is invalid. Valid values are "
+                     "{off, thp, hugetlb}."
+                  << std::endl;
+        return -1;
+      }
+    } else if (arg.first.compare("engine") == 0) {
+      if (!tps::parse_engine(arg.second, &engine)) {
+        std::cerr << "Value of 'engine' is invalid. Valid values are "
+                     "{read, pread, preadv, mmap, splice, sendfile, uring}."
+                  << std::endl;
+        return -1;
+      }
+    } else if (arg.first.compare("counters") == 0) {
+      if (!tps::parse_bool(arg.second, &counters)) {
+        std::cerr << "Value of 'counters' is invalid. Valid values are "
+                     "{true, t, yes, y, 1, false, f, no, n, 0}."
+                  << std::endl;
+        return -1;
+      }
+    } else if (arg.first.compare("placement") == 0) {
+      if (!tps::parse_placement(arg.second, &placement)) {
+        std::cerr << "Value of 'placement' is invalid. Valid values are "
+                     "{global, per-dir}."
+                  << std::endl;
+        return -1;
+      }
+    } else if (arg.first.compare("cache") == 0) {
+      if (!tps::parse_cache_mode(arg.second, &cache)) {
+        std::cerr << "Value of 'cache' is invalid. Valid values are "
+                     "{cold, warm, as-is}."
+                  << std::endl;
+        return -1;
+      }
+    } else if (arg.first.compare("mem-limit") == 0) {
+      mem_limit = tps::size_in_bytes(arg.second);
+    } else if (arg.first.compare("rate") == 0) {
+      rate_limit = tps::size_in_bytes(arg.second);
+    } else if (arg.first.compare("ioprio") == 0) {
+      if (!tps::parse_io_priority(arg.second, &io_priority)) {
+        std::cerr << "Value of 'ioprio' is invalid. Valid values are "
+                     "{none, idle, be/0..7, rt/0..7}."
+                  << std::endl;
+        return -1;
+      }
+    } else if (arg.first.compare("trace") == 0) {
+      trace_path = arg.second;
+    } else if (arg.first.compare("repeat") == 0)
+      repeat = std::max(1, std::stoi(arg.second));
+    else if (arg.first.compare("baseline") == 0)
+      baseline_path = arg.second;
+    else if (arg.first.compare("save-baseline") == 0)
+      save_path = arg.second;
+    else if (arg.first.compare("output") == 0) {
+      if (!tps::parse_output(arg.second, &output)) {
+        std::cerr << "Value of 'output' is invalid. Valid values are "
+                     "{text, json, csv}."
+                  << std::endl;
+        return -1;
+      }
+    } else if (arg.first.compare("interval") == 0)
+      interval = std::max(0LL, tps::time_in_ns(arg.second));
+    else if (arg.first.compare("warmup") == 0) {
+      if (!tps::parse_warmup(arg.second, &warmup_time, &warmup_ops)) {
+        std::cerr << "Value of 'warmup' is invalid. Valid values are a time "
+                     "or a number of operations, e.g. 5s or 1000ops."
+                  << std::endl;
+        return -1;
+      }
+    } else if (arg.first.compare("steady") == 0)
+      steady_cv = std::max(0.0, std::stod(arg.second));
     else {
       std::cerr << "Invalid key '" << arg.first
                 << "'. Valid keys are "
-                   "{dir, record-size, max-time, buffered, threads}."
+                   "{dir, record-size, max-time, buffered, threads, "
+                   "hugepages, engine, output, interval, warmup, steady, "
+                   "counters, procs, cache, mem-limit, placement, trace, "
+                   "repeat, baseline, save-baseline, rate, ioprio}."
                 << std::endl;
       return -1;
     }
   }
 
-  tps::FileLookup fl(dir_path, record_size, max_time, buffered, num_threads);
-  fl.print_arguments();
-  fl.start_read();
-  std::cout.imbue(std::locale("en_US.UTF-8"));
-  std::cout << "operations: " << fl.total_ops() << std::endl;
-  std::cout << "total time: " << fl.total_time() << " ns" << std::endl;
-  std::cout << "total size: " << fl.total_bytes() << " bytes" << std::endl;
-  std::cout << "total records: " << fl.total_records() << std::endl;
-  std::cout << "throughput: "
-            << tps::to_bytes_per_sec(fl.total_bytes(), fl.total_time())
-            << " bytes/sec, "
-            << tps::to_bytes_per_sec(fl.total_records(), fl.total_time())
-            << " records/sec" << std::endl;
-  return 0;
-}
\ No newline at end of file
+  if (engine == tps::Engine::MMAP && !buffered) {
+    std::cerr << "Engine 'mmap' reads through the page cache, it cannot be "
+                 "combined with 'buffered=false'."
+              << std::endl;
+    return -1;
+  }
+
+  // Every combination of record size and threads is a point run for
+  // max-time, all on the file list loaded here
+  size_t num_points = record_sizes.size() * threads.size();
+  if (!trace_path.empty() &&
+      (num_points > 1 || num_procs > 1 || repeat > 1)) {
+    std::cerr << "A trace records a single run, 'trace' cannot be combined "
+                 "with a sweep, 'procs' or 'repeat'."
+              << std::endl;
+    return -1;
+  }
+  if ((!baseline_path.empty() || !save_path.empty()) && repeat < 2) {
+    std::cerr << "A baseline needs the spread of several runs, 'baseline' and "
+                 "'save-baseline' need 'repeat' of 2 or more."
+              << std::endl;
+    return -1;
+  }
+  tps::Baseline baseline;
+  if (!baseline_path.empty()) baseline.load(baseline_path);
+  tps::Baseline saved;
+  size_t regressions = 0;
+  std::shared_ptr<const tps::FileList> files = tps::FileList::load(dir_path);
+  tps::ScalingTable table;
+  auto configure = [&](tps::FileLookup *fl) {
+    fl->set_huge_pages(huge_pages);
+    fl->set_engine(engine, 0, 1);
+    fl->set_output(output);
+    fl->set_counters(counters);
+    fl->set_procs(num_procs);
+    fl->set_cache(cache);
+    fl->set_placement(placement);
+    fl->set_trace(trace_path);
+    fl->set_rate_limit(rate_limit);
+    fl->set_io_priority(io_priority);
+    fl->set_mem_limit(mem_limit);
+    fl->set_interval(interval);
+    fl->set_warmup(warmup_time, warmup_ops, steady_cv);
+  };
+
+  if (output == tps::Output::TEXT)
+    std::cout.imbue(std::locale("en_US.UTF-8"));
+  if (output == tps::Output::JSON && num_points > 1)
+    std::cout << "[" << std::endl;
+  for (size_t point = 0; point < num_points; point++) {
+    size_t record_size = record_sizes[point / threads.size()];
+    int num_threads = static_cast<int>(threads[point % threads.size()]);
+    if (output == tps::Output::TEXT && point > 0) std::cout << std::endl;
+
+    // Every run of a repeated point is a fresh reader, only the summary of
+    // the runs is printed
+    if (repeat > 1) {
+      std::string label = "record-size=" + std::to_string(record_size) +
+                          ",threads=" + std::to_string(num_threads);
+      tps::RepeatStats stats;
+      tps::Arguments arguments;
+      for (int run = 0; run < repeat; run++) {
+        tps::FileLookup fl(files, record_size, max_time, buffered,
+                           num_threads);
+        configure(&fl);
+        fl.set_record_latency(true);
+        if (run == 0) {
+          fl.print_arguments();
+          arguments = fl.arguments();
+          arguments.push_back({"repeat", std::to_string(repeat)});
+          if (output == tps::Output::TEXT)
+            std::cout << "# repeat = " << repeat << std::endl;
+        }
+        fl.start_read();
+        stats.add_run(fl);
+        if (output == tps::Output::TEXT) stats.print_run(std::cout);
+      }
+      saved.add(label, stats);
+      const tps::ScalingTable::Point &p =
+          table.add(record_size, 1, num_threads * num_procs,
+                    stats.ops_per_sec().mean, stats.bytes_per_sec().mean);
+
+      if (output != tps::Output::TEXT) {
+        tps::Report report(arguments);
+        stats.add_results(&report);
+        regressions += baseline.compare_to(label, stats, nullptr, &report);
+        if (num_points > 1) {
+          report.add_ratio("speedup", p.speedup);
+          report.add_ratio("efficiency", p.efficiency);
+        }
+        if (output == tps::Output::JSON) {
+          if (point > 0) std::cout << "," << std::endl;
+          report.print_json(std::cout);
+        } else {
+          report.print_csv(std::cout, point == 0);
+        }
+        continue;
+      }
+      stats.print(std::cout);
+      regressions += baseline.compare_to(label, stats, &std::cout, nullptr);
+      continue;
+    }
+
+    tps::FileLookup fl(files, record_size, max_time, buffered, num_threads);
+    configure(&fl);
+    fl.print_arguments();
+    fl.start_read();
+    const tps::ScalingTable::Point &p = table.add(
+        record_size, 1, num_threads * num_procs,
+        tps::to_bytes_per_sec(fl.total_ops(), fl.total_time()),
+        tps::to_bytes_per_sec(fl.total_bytes(), fl.total_time()));
+
+    if (output != tps::Output::TEXT) {
+      tps::Report report(fl.arguments());
+      report.add_result("operations", fl.total_ops());
+      report.add_result("total_time_ns", fl.total_time());
+      report.add_result("total_bytes", fl.total_bytes());
+      report.add_result("total_records", fl.total_records());
+      report.add_result("bytes_per_sec",
+                        tps::to_bytes_per_sec(fl.total_bytes(),
+                                              fl.total_time()));
+      report.add_result("records_per_sec",
+                        tps::to_bytes_per_sec(fl.total_records(),
+                                              fl.total_time()));
+      fl.add_dir_results(&report);
+      tps::add_cache_residency(&report, fl.cache_before(), fl.cache_after());
+      tps::add_disk_io(&report, fl.disk_io(), fl.logical_bytes(), 0);
+      if (fl.has_mem_limit())
+        tps::add_balloon(&report, fl.balloon().bytes(), fl.balloon().locked(),
+                         fl.balloon().budget());
+      tps::add_cpu_usage(&report, fl.cpu_usage(), fl.total_ops(),
+                         fl.total_bytes());
+      tps::add_perf_counts(&report, fl.perf_counts(), fl.total_ops(),
+                           fl.total_bytes());
+      if (fl.has_warmup()) fl.add_warmup_results(&report);
+      if (num_points > 1) {
+        report.add_ratio("speedup", p.speedup);
+        report.add_ratio("efficiency", p.efficiency);
+      }
+      report.add_threads(fl.thread_stats());
+      if (output == tps::Output::JSON) {
+        if (point > 0) std::cout << "," << std::endl;
+        report.print_json(std::cout);
+      } else {
+        report.print_csv(std::cout, point == 0);
+      }
+      continue;
+    }
+
+    if (fl.has_warmup()) fl.print_warmup(std::cout);
+    std::cout << "operations: " << fl.total_ops() << std::endl;
+    std::cout << "total time: " << fl.total_time() << " ns" << std::endl;
+    std::cout << "total size: " << fl.total_bytes() << " bytes" << std::endl;
+    std::cout << "total records: " << fl.total_records() << std::endl;
+    std::cout << "throughput: "
+              << tps::to_bytes_per_sec(fl.total_bytes(), fl.total_time())
+              << " bytes/sec, "
+              << tps::to_bytes_per_sec(fl.total_records(), fl.total_time())
+              << " records/sec" << std::endl;
+    fl.print_dir_results(std::cout);
+    tps::print_cache_residency(std::cout, fl.cache_before(), fl.cache_after());
+    tps::print_disk_io(std::cout, fl.disk_io(), fl.logical_bytes(), 0);
+    if (fl.has_mem_limit())
+      tps::print_balloon(std::cout, fl.balloon().bytes(), fl.balloon().locked(),
+                         fl.balloon().budget());
+    tps::print_cpu_usage(std::cout, fl.cpu_usage(), fl.total_ops(),
+                         fl.total_bytes());
+    tps::print_perf_counts(std::cout, fl.perf_counts(), fl.total_ops(),
+                           fl.total_bytes());
+  }
+
+  if (output == tps::Output::JSON && num_points > 1)
+    std::cout << "]" << std::endl;
+  if (output == tps::Output::TEXT && num_points > 1) {
+    std::cout << std::endl;
+    table.print(std::cout, false);
+  }
+  if (!save_path.empty()) saved.save(save_path);
+  return regressions > 0 ? 2 : 0;
+}
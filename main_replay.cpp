@@ -0,0 +1,245 @@
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "file_replay.hpp"
+#include "balloon.hpp"
+#include "buffer.hpp"
+#include "cache.hpp"
+#include "cpu_usage.hpp"
+#include "disk_io.hpp"
+#include "helper.hpp"
+#include "report.hpp"
+#include "trace.hpp"
+
+int main(int argc, char *argv[]) {
+  if (argc < 4) {
+    std::cout << "Usage: " << argv[0] << " [key=value]..." << std::endl;
+    std::cout << "  Keys:" << std::endl;
+    std::cout << "    -       trace: Trace recorded by file_lookup or "
+                 "file_scan."
+              << std::endl;
+    std::cout << "    - record-size: Size of the chunks a record is read in."
+              << std::endl;
+    std::cout << "                   e.g. 12, 34b, 2kB, 3MB, 4GB" << std::endl;
+    std::cout << "    -     threads: Number of threads issuing the records."
+              << std::endl;
+    std::cout << "  Optional keys:" << std::endl;
+    std::cout << "    -         dir: Directories to replay against instead "
+                 "of the recorded ones."
+              << std::endl;
+    std::cout << "                   dir1,dir2,... as many as recorded"
+              << std::endl;
+    std::cout << "    -      timing: Issue records as fast as possible or at "
+                 "their recorded time."
+              << std::endl;
+    std::cout << "                   {fast, original}, default fast"
+              << std::endl;
+    std::cout << "    -    max-time: Max running time." << std::endl;
+    std::cout << "                   e.g. 300, 10{h, min, s, ms, us, ns}, "
+                 "default 0 (whole trace)"
+              << std::endl;
+    std::cout << "    -    buffered: Buffered read." << std::endl;
+    std::cout << "                   {true, false}, default true" << std::endl;
+    std::cout << "    -   hugepages: Huge pages backing the I/O buffers."
+              << std::endl;
+    std::cout << "                   {off, thp, hugetlb}, default off"
+              << std::endl;
+    std::cout << "    -      engine: How file contents are moved." << std::endl;
+    std::cout << "                   {read, pread, preadv, mmap, splice, "
+                 "sendfile, uring},"
+              << std::endl;
+    std::cout << "                   default read" << std::endl;
+    std::cout << "    -    interval: Print throughput and latency every "
+                 "interval while running."
+              << std::endl;
+    std::cout << "                   e.g. 1s, 500ms, default 0 (off)"
+              << std::endl;
+    std::cout << "    -       cache: Page cache state of the files before "
+                 "the replay."
+              << std::endl;
+    std::cout << "                   {cold, warm, as-is}, default as-is"
+              << std::endl;
+    std::cout << "    -   mem-limit: Memory left available to the page cache, "
+                 "the rest is"
+              << std::endl;
+    std::cout << "                   held by a locked balloon during the "
+                 "replay."
+              << std::endl;
+    std::cout << "                   e.g. 512MB, 4GB, default 0 (off)"
+              << std::endl;
+    std::cout << "    -      output: Format of the results." << std::endl;
+    std::cout << "                   {text, json, csv}, default text"
+              << std::endl;
+    std::cout << "    -    counters: Count cycles, instructions and LLC misses."
+              << std::endl;
+    std::cout << "                   {true, false}, default false" << std::endl;
+    return 0;
+  }
+
+  std::string trace_path;
+  std::string dir_path;
+  size_t record_size = 0;
+  int num_threads = 1;
+  tps::ReplayTiming timing = tps::ReplayTiming::FAST;
+  long long max_time = 0;
+  bool buffered = true;
+  tps::HugePages huge_pages = tps::HugePages::OFF;
+  tps::Engine engine = tps::Engine::READ;
+  tps::Output output = tps::Output::TEXT;
+  tps::CacheMode cache = tps::CacheMode::AS_IS;
+  size_t mem_limit = 0;
+  bool counters = false;
+  long long interval = 0;
+
+  for (int i = 1; i < argc; i++) {
+    std::pair<std::string, std::string> arg = tps::parse_arg(argv[i]);
+    if (arg.first.compare("trace") == 0)
+      trace_path = arg.second;
+    else if (arg.first.compare("dir") == 0)
+      dir_path = arg.second;
+    else if (arg.first.compare("record-size") == 0)
+      record_size = tps::size_in_bytes(arg.second);
+    else if (arg.first.compare("threads") == 0)
+      num_threads = std::max(1, std::stoi(arg.second));
+    else if (arg.first.compare("timing") == 0) {
+      if (!tps::parse_replay_timing(arg.second, &timing)) {
+        std::cerr << "Value of 'timing' is invalid. Valid values are "
+                     "{fast, original}."
+                  << std::endl;
+        return -1;
+      }
+    } else if (arg.first.compare("max-time") == 0)
+      max_time = std::max(0LL, tps::time_in_ns(arg.second));
+    else if (arg.first.compare("buffered") == 0) {
+      if (!tps::parse_bool(arg.second, &buffered)) {
+        std::cerr << "Value of 'buffered' is invalid. Valid values are "
+                     "{true, t, yes, y, 1, false, f, no, n, 0}."
+                  << std::endl;
+        return -1;
+      }
+    } else if (arg.first.compare("hugepages") == 0) {
+      if (!tps::parse_huge_pages(arg.second, &huge_pages)) {
+        std::cerr << "Value of 'hugepages' is invalid. Valid values are "
+                     "{off, thp, hugetlb}."
+                  << std::endl;
+        return -1;
+      }
+    } else if (arg.first.compare("engine") == 0) {
+      if (!tps::parse_engine(arg.second, &engine)) {
+        std::cerr << "Value of 'engine' is invalid. Valid values are "
+                     "{read, pread, preadv, mmap, splice, sendfile, uring}."
+                  << std::endl;
+        return -1;
+      }
+    } else if (arg.first.compare("counters") == 0) {
+      if (!tps::parse_bool(arg.second, &counters)) {
+        std::cerr << "Value of 'counters' is invalid. Valid values are "
+                     "{true, t, yes, y, 1, false, f, no, n, 0}."
+                  << std::endl;
+        return -1;
+      }
+    } else if (arg.first.compare("cache") == 0) {
+      if (!tps::parse_cache_mode(arg.second, &cache)) {
+        std::cerr << "Value of 'cache' is invalid. Valid values are "
+                     "{cold, warm, as-is}."
+                  << std::endl;
+        return -1;
+      }
+    } else if (arg.first.compare("mem-limit") == 0) {
+      mem_limit = tps::size_in_bytes(arg.second);
+    } else if (arg.first.compare("output") == 0) {
+      if (!tps::parse_output(arg.second, &output)) {
+        std::cerr << "Value of 'output' is invalid. Valid values are "
+                     "{text, json, csv}."
+                  << std::endl;
+        return -1;
+      }
+    } else if (arg.first.compare("interval") == 0)
+      interval = std::max(0LL, tps::time_in_ns(arg.second));
+    else {
+      std::cerr << "Invalid key '" << arg.first
+                << "'. Valid keys are "
+                   "{trace, record-size, threads, dir, timing, max-time, "
+                   "buffered, hugepages, engine, output, interval, "
+                   "counters, cache, mem-limit}."
+                << std::endl;
+      return -1;
+    }
+  }
+
+  if (record_size == 0) {
+    std::cerr << "Key 'record-size' is missing or 0." << std::endl;
+    return -1;
+  }
+
+  if (engine == tps::Engine::MMAP && !buffered) {
+    std::cerr << "Engine 'mmap' reads through the page cache, it cannot be "
+                 "combined with 'buffered=false'."
+              << std::endl;
+    return -1;
+  }
+
+  tps::FileReplay fr(tps::Trace::load(trace_path), dir_path, record_size,
+                     max_time, buffered, num_threads);
+  fr.set_timing(timing);
+  fr.set_huge_pages(huge_pages);
+  fr.set_engine(engine, 0, 1);
+  fr.set_output(output);
+  fr.set_counters(counters);
+  fr.set_cache(cache);
+  fr.set_mem_limit(mem_limit);
+  fr.set_interval(interval);
+  fr.print_arguments();
+  fr.start_read();
+
+  if (output != tps::Output::TEXT) {
+    tps::Report report(fr.arguments());
+    report.add_result("operations", fr.total_ops());
+    report.add_result("total_time_ns", fr.total_time());
+    report.add_result("total_bytes", fr.total_bytes());
+    report.add_result("bytes_per_sec",
+                      tps::to_bytes_per_sec(fr.total_bytes(), fr.total_time()));
+    report.add_result("ops_per_sec",
+                      tps::to_bytes_per_sec(fr.total_ops(), fr.total_time()));
+    fr.add_replay_results(&report);
+    fr.add_dir_results(&report);
+    tps::add_cache_residency(&report, fr.cache_before(), fr.cache_after());
+    tps::add_disk_io(&report, fr.disk_io(), fr.logical_bytes(), 0);
+    if (fr.has_mem_limit())
+      tps::add_balloon(&report, fr.balloon().bytes(), fr.balloon().locked(),
+                       fr.balloon().budget());
+    tps::add_cpu_usage(&report, fr.cpu_usage(), fr.total_ops(),
+                       fr.total_bytes());
+    tps::add_perf_counts(&report, fr.perf_counts(), fr.total_ops(),
+                         fr.total_bytes());
+    report.add_threads(fr.thread_stats());
+    if (output == tps::Output::JSON)
+      report.print_json(std::cout);
+    else
+      report.print_csv(std::cout, true);
+    return 0;
+  }
+
+  std::cout.imbue(std::locale("en_US.UTF-8"));
+  std::cout << "operations: " << fr.total_ops() << std::endl;
+  std::cout << "total time: " << fr.total_time() << " ns" << std::endl;
+  std::cout << "total size: " << fr.total_bytes() << " bytes" << std::endl;
+  std::cout << "throughput: "
+            << tps::to_bytes_per_sec(fr.total_bytes(), fr.total_time())
+            << " bytes/sec, "
+            << tps::to_bytes_per_sec(fr.total_ops(), fr.total_time())
+            << " ops/sec" << std::endl;
+  fr.print_replay(std::cout);
+  fr.print_dir_results(std::cout);
+  tps::print_cache_residency(std::cout, fr.cache_before(), fr.cache_after());
+  tps::print_disk_io(std::cout, fr.disk_io(), fr.logical_bytes(), 0);
+  if (fr.has_mem_limit())
+    tps::print_balloon(std::cout, fr.balloon().bytes(), fr.balloon().locked(),
+                       fr.balloon().budget());
+  tps::print_cpu_usage(std::cout, fr.cpu_usage(), fr.total_ops(),
+                       fr.total_bytes());
+  tps::print_perf_counts(std::cout, fr.perf_counts(), fr.total_ops(),
+                         fr.total_bytes());
+  return 0;
+}
@@ -5,13 +5,21 @@
 #include <vector>
 
 #include "file_write.hpp"
+#include "buffer.hpp"
+#include "cpu_usage.hpp"
+#include "disk_io.hpp"
+#include "file_list.hpp"
 #include "helper.hpp"
+#include "report.hpp"
 
 int main(int argc, char *argv[]) {
-  if (argc != 5) {
+  if (argc < 5) {
     std::cout << "Usage: " << argv[0] << " [key=value]..." << std::endl;
     std::cout << "  Keys:" << std::endl;
     std::cout << "    -        dir: Path to the output directory." << std::endl;
+    std::cout << "                  dir1,dir2,... stripes the files over the "
+                 "directories."
+              << std::endl;
     std::cout << "    - total-size: Total data size to write." << std::endl;
     std::cout << "                  e.g. 12, 34b, 2kB, 3MB, 4GB" << std::endl;
     std::cout << "    -  file-size: Maximum file size." << std::endl;
@@ -22,6 +30,29 @@ int main(int argc, char *argv[]) {
     std::cout << "    - sequential: Write files sequentially." << std::endl;
     std::cout << "                  {true, t, yes, y, 1, false, f, no, n, 0}"
               << std::endl;
+    std::cout << "  Optional keys:" << std::endl;
+    std::cout << "    -  hugepages: Huge pages backing the write buffer."
+              << std::endl;
+    std::cout << "                  {off, thp, hugetlb}, default off"
+              << std::endl;
+    std::cout << "    -     output: Format of the results." << std::endl;
+    std::cout << "                  {text, json, csv}, default text"
+              << std::endl;
+    std::cout << "    -   counters: Count cycles, instructions and LLC misses."
+              << std::endl;
+    std::cout << "                  {true, false}, default false" << std::endl;
+    std::cout << "    -   manifest: Write a manifest of the files that readers "
+                 "load"
+              << std::endl;
+    std::cout << "                  instead of listing the directory."
+              << std::endl;
+    std::cout << "                  {true, false}, default false" << std::endl;
+    std::cout << "    -     stripe: How files are spread over several "
+                 "directories."
+              << std::endl;
+    std::cout << "                  {round-robin, capacity}, default "
+                 "round-robin"
+              << std::endl;
     return 0;
   }
 
@@ -29,6 +60,11 @@ int main(int argc, char *argv[]) {
   size_t total_size = 0;
   size_t file_size = 0;
   bool sequential = true;
+  tps::HugePages huge_pages = tps::HugePages::OFF;
+  tps::Output output = tps::Output::TEXT;
+  bool counters = false;
+  bool manifest = false;
+  tps::Stripe stripe = tps::Stripe::ROUND_ROBIN;
 
   for (int i = 1; i < argc; i++) {
     std::pair<std::string, std::string> arg = tps::parse_arg(argv[i]);
@@ -54,16 +90,57 @@ int main(int argc, char *argv[]) {
                   << std::endl;
         return -1;
       }
+    } else if (arg.first.compare("hugepages") == 0) {
+      if (!tps::parse_huge_pages(arg.second, &huge_pages)) {
+        std::cerr << "Value of 'hugepages' is invalid. Valid values are "
+                     "{off, thp, hugetlb}."
+                  << std::endl;
+        return -1;
+      }
+    } else if (arg.first.compare("counters") == 0) {
+      if (!tps::parse_bool(arg.second, &counters)) {
+        std::cerr << "Value of 'counters' is invalid. Valid values are "
+                     "{true, t, yes, y, 1, false, f, no, n, 0}."
+                  << std::endl;
+        return -1;
+      }
+    } else if (arg.first.compare("manifest") == 0) {
+      if (!tps::parse_bool(arg.second, &manifest)) {
+        std::cerr << "Value of 'manifest' is invalid. Valid values are "
+                     "{true, t, yes, y, 1, false, f, no, n, 0}."
+                  << std::endl;
+        return -1;
+      }
+    } else if (arg.first.compare("stripe") == 0) {
+      if (!tps::parse_stripe(arg.second, &stripe)) {
+        std::cerr << "Value of 'stripe' is invalid. Valid values are "
+                     "{round-robin, capacity}."
+                  << std::endl;
+        return -1;
+      }
+    } else if (arg.first.compare("output") == 0) {
+      if (!tps::parse_output(arg.second, &output)) {
+        std::cerr << "Value of 'output' is invalid. Valid values are "
+                     "{text, json, csv}."
+                  << std::endl;
+        return -1;
+      }
     } else {
       std::cerr << "Invalid key '" << arg.first
                 << "'. Valid keys are "
-                   "{dir, total-size, file-size, sequential}."
+                   "{dir, total-size, file-size, sequential, hugepages, "
+                   "output, counters, manifest, stripe}."
                 << std::endl;
       return -1;
     }
   }
 
   tps::FileWrite fw(dir_path, total_size, file_size, sequential);
+  fw.set_huge_pages(huge_pages);
+  fw.set_output(output);
+  fw.set_counters(counters);
+  fw.set_manifest(manifest);
+  fw.set_stripe(stripe);
   fw.print_arguments();
   std::unordered_map<std::string, long long> results = fw.write();
   std::vector<std::string> files;
@@ -72,15 +149,53 @@ int main(int argc, char *argv[]) {
     files.push_back(it->first);
   std::sort(files.begin(), files.end());
 
+  // Files are written one after another, so a directory's throughput is
+  // over the time spent on its own files
+  size_t num_dirs = fw.dirs().size();
+  std::vector<size_t> dir_written(num_dirs, 0);
+  std::vector<long long> dir_time(num_dirs, 0);
   size_t total_written = 0;
   size_t total_time = 0;
+  if (output != tps::Output::TEXT) {
+    for (std::string f : files) {
+      size_t fsize = tps::get_file_size(fw.file_path(f));
+      total_written += fsize;
+      total_time += results[f];
+      dir_written[fw.file_dir(f)] += fsize;
+      dir_time[fw.file_dir(f)] += results[f];
+    }
+    tps::Report report(fw.arguments());
+    report.add_result("total_time_ns", total_time);
+    report.add_result("total_bytes", total_written);
+    report.add_result("bytes_per_sec",
+                      tps::to_bytes_per_sec(total_written, total_time));
+    tps::add_disk_io(&report, fw.disk_io(), 0, total_written);
+    tps::add_cpu_usage(&report, fw.cpu_usage(), files.size(),
+                       total_written);
+    tps::add_perf_counts(&report, fw.perf_counts(), files.size(),
+                         total_written);
+    if (num_dirs > 1) {
+      for (size_t d = 0; d < num_dirs; d++)
+        tps::add_dir_throughput(&report, d, dir_written[d], dir_time[d]);
+    }
+    report.add_threads({{0, files.size(), total_written, 0, files.size(),
+                         static_cast<long long>(total_time)}});
+    if (output == tps::Output::JSON)
+      report.print_json(std::cout);
+    else
+      report.print_csv(std::cout, true);
+    return 0;
+  }
+
   std::cout.imbue(std::locale("en_US.UTF-8"));
   for (std::string f : files) {
-    size_t fsize = tps::get_file_size(dir_path + "/" + f);
+    size_t fsize = tps::get_file_size(fw.file_path(f));
     std::cout << "file=" << f << ", size=" << fsize << ", time=" << results[f]
               << std::endl;
     total_written += fsize;
     total_time += results[f];
+    dir_written[fw.file_dir(f)] += fsize;
+    dir_time[fw.file_dir(f)] += results[f];
   }
   std::cout << std::endl;
   std::cout << "total time: " << total_time << " ns" << std::endl;
@@ -88,5 +203,15 @@ int main(int argc, char *argv[]) {
   std::cout << "throughput: "
             << tps::to_bytes_per_sec(total_written, total_time) << " bytes/sec"
             << std::endl;
+  if (num_dirs > 1) {
+    for (size_t d = 0; d < num_dirs; d++)
+      tps::print_dir_throughput(std::cout, fw.dirs()[d], dir_written[d],
+                                dir_time[d]);
+  }
+  tps::print_disk_io(std::cout, fw.disk_io(), 0, total_written);
+  tps::print_cpu_usage(std::cout, fw.cpu_usage(), files.size(),
+                       total_written);
+  tps::print_perf_counts(std::cout, fw.perf_counts(), files.size(),
+                         total_written);
   return 0;
 }
\ No newline at end of file
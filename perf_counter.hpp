@@ -0,0 +1,217 @@
+#ifndef PERF_COUNTER_HPP
+#define PERF_COUNTER_HPP
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "report.hpp"
+
+namespace tps {
+
+// Counts of a PerfGroup. An event that was not asked for or that the
+// kernel refused is not valid and stays 0.
+struct PerfCounts {
+  enum Event { CYCLES, INSTRUCTIONS, LLC_MISSES, DTLB_MISSES, NUM_EVENTS };
+
+  uint64_t value[NUM_EVENTS];
+  bool valid[NUM_EVENTS];
+  bool enabled[NUM_EVENTS];
+  size_t merged;
+
+  PerfCounts() : merged(0) {
+    for (int i = 0; i < NUM_EVENTS; i++) {
+      value[i] = 0;
+      valid[i] = false;
+      enabled[i] = false;
+    }
+  }
+
+  // Sum of the threads, an event is valid only if it was on all of them
+  PerfCounts &operator+=(const PerfCounts &other) {
+    for (int i = 0; i < NUM_EVENTS; i++) {
+      value[i] += other.value[i];
+      valid[i] = (merged == 0 || valid[i]) && other.valid[i];
+      enabled[i] = enabled[i] || other.enabled[i];
+    }
+    merged++;
+    return *this;
+  }
+
+  bool has(Event e) const { return valid[e]; }
+  uint64_t get(Event e) const { return value[e]; }
+
+  double ipc() const {
+    return value[CYCLES] == 0 ? 0.0
+                              : 1.0 * value[INSTRUCTIONS] / value[CYCLES];
+  }
+};
+
+// Hardware counters of the calling thread opened as one perf_event_open
+// group so that they cover the same cycles. Events the kernel or the
+// container does not allow are left out, when none opens the group counts
+// nothing.
+class PerfGroup {
+ public:
+  // Cycles, instructions, LLC and dTLB misses when all is true, otherwise
+  // only dTLB misses
+  explicit PerfGroup(bool all) : leader_(-1), num_fds_(0) {
+    if (all) {
+      add(PerfCounts::CYCLES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+      add(PerfCounts::INSTRUCTIONS, PERF_TYPE_HARDWARE,
+          PERF_COUNT_HW_INSTRUCTIONS);
+      add(PerfCounts::LLC_MISSES, PERF_TYPE_HARDWARE,
+          PERF_COUNT_HW_CACHE_MISSES);
+    }
+    add(PerfCounts::DTLB_MISSES, PERF_TYPE_HW_CACHE,
+        PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+  }
+
+  ~PerfGroup() {
+    for (int i = 0; i < num_fds_; i++) close(fds_[i]);
+  }
+
+  PerfGroup(const PerfGroup &) = delete;
+  PerfGroup &operator=(const PerfGroup &) = delete;
+
+  // Reset and start all events, again after warm-up
+  void start() {
+    if (leader_ == -1) return;
+    ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+
+  // Stop all events and read them, scaled up if the group was multiplexed
+  void stop() {
+    if (leader_ == -1) return;
+    ioctl(leader_, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    // nr, time enabled, time running, then one value per event
+    uint64_t buf[3 + PerfCounts::NUM_EVENTS];
+    ssize_t n = ::read(leader_, buf, sizeof(buf));
+    if (n < static_cast<ssize_t>(3 * sizeof(uint64_t)) ||
+        buf[0] != static_cast<uint64_t>(num_fds_) || buf[2] == 0)
+      return;
+    double scale = buf[2] < buf[1] ? 1.0 * buf[1] / buf[2] : 1.0;
+    for (int i = 0; i < num_fds_; i++) {
+      counts_.value[events_[i]] =
+          static_cast<uint64_t>(buf[3 + i] * scale + 0.5);
+      counts_.valid[events_[i]] = true;
+    }
+  }
+
+  const PerfCounts &counts() const { return counts_; }
+
+ private:
+  void add(PerfCounts::Event event, uint32_t type, uint64_t config) {
+    counts_.enabled[event] = true;
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = leader_ == -1 ? 1 : 0;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+    int fd = open_event(&attr, leader_);
+    if (fd == -1 && (errno == EACCES || errno == EPERM)) {
+      // perf_event_paranoid >= 2 only allows counting user space
+      attr.exclude_kernel = 1;
+      fd = open_event(&attr, leader_);
+    }
+    if (fd == -1) return;
+    if (leader_ == -1) leader_ = fd;
+    fds_[num_fds_] = fd;
+    events_[num_fds_++] = event;
+  }
+
+  static int open_event(struct perf_event_attr *attr, int group_fd) {
+    return static_cast<int>(
+        syscall(__NR_perf_event_open, attr, 0, -1, group_fd, 0));
+  }
+
+  int leader_;
+  int fds_[PerfCounts::NUM_EVENTS];
+  PerfCounts::Event events_[PerfCounts::NUM_EVENTS];
+  int num_fds_;
+  PerfCounts counts_;
+};
+
+// Events that were asked for, n/a for the ones that could not be counted
+static void print_perf_counts(std::ostream &os, const PerfCounts &counts,
+                              size_t ops, size_t bytes) {
+  double kb = bytes / 1024.0;
+  if (counts.enabled[PerfCounts::CYCLES]) {
+    if (counts.has(PerfCounts::CYCLES) &&
+        counts.has(PerfCounts::INSTRUCTIONS)) {
+      os << "cycles: " << counts.get(PerfCounts::CYCLES) << ", per op: "
+         << (ops == 0 ? 0.0 : 1.0 * counts.get(PerfCounts::CYCLES) / ops)
+         << std::endl;
+      os << "instructions: " << counts.get(PerfCounts::INSTRUCTIONS)
+         << ", per op: "
+         << (ops == 0 ? 0.0
+                      : 1.0 * counts.get(PerfCounts::INSTRUCTIONS) / ops)
+         << ", IPC: " << counts.ipc() << std::endl;
+    } else {
+      os << "cycles: n/a" << std::endl;
+      os << "instructions: n/a" << std::endl;
+    }
+  }
+  if (counts.enabled[PerfCounts::LLC_MISSES]) {
+    if (counts.has(PerfCounts::LLC_MISSES))
+      os << "LLC misses: " << counts.get(PerfCounts::LLC_MISSES)
+         << ", per KB: "
+         << (kb == 0.0 ? 0.0 : counts.get(PerfCounts::LLC_MISSES) / kb)
+         << std::endl;
+    else
+      os << "LLC misses: n/a" << std::endl;
+  }
+  if (counts.has(PerfCounts::DTLB_MISSES))
+    os << "dTLB misses: " << counts.get(PerfCounts::DTLB_MISSES)
+       << ", per KB: "
+       << (kb == 0.0 ? 0.0 : counts.get(PerfCounts::DTLB_MISSES) / kb)
+       << std::endl;
+  else
+    os << "dTLB misses: n/a" << std::endl;
+}
+
+// Only the events that could be counted
+static void add_perf_counts(Report *report, const PerfCounts &counts,
+                            size_t ops, size_t bytes) {
+  double kb = bytes / 1024.0;
+  if (counts.has(PerfCounts::CYCLES) && counts.has(PerfCounts::INSTRUCTIONS)) {
+    report->add_result("cycles", counts.get(PerfCounts::CYCLES));
+    report->add_result("instructions", counts.get(PerfCounts::INSTRUCTIONS));
+    report->add_ratio("ipc", counts.ipc());
+    report->add_ratio(
+        "cycles_per_op",
+        ops == 0 ? 0.0 : 1.0 * counts.get(PerfCounts::CYCLES) / ops);
+    report->add_ratio(
+        "instructions_per_op",
+        ops == 0 ? 0.0 : 1.0 * counts.get(PerfCounts::INSTRUCTIONS) / ops);
+  }
+  if (counts.has(PerfCounts::LLC_MISSES)) {
+    report->add_result("llc_misses", counts.get(PerfCounts::LLC_MISSES));
+    report->add_ratio(
+        "llc_misses_per_kb",
+        kb == 0.0 ? 0.0 : counts.get(PerfCounts::LLC_MISSES) / kb);
+  }
+  if (counts.has(PerfCounts::DTLB_MISSES)) {
+    report->add_result("dtlb_misses", counts.get(PerfCounts::DTLB_MISSES));
+    report->add_ratio(
+        "dtlb_misses_per_kb",
+        kb == 0.0 ? 0.0 : counts.get(PerfCounts::DTLB_MISSES) / kb);
+  }
+}
+
+}  // namespace tps
+
+#endif  // PERF_COUNTER_HPP
@@ -0,0 +1,49 @@
+#ifndef RATE_LIMIT_HPP
+#define RATE_LIMIT_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+
+#include "run_control.hpp"
+
+namespace tps {
+
+// Holds one thread to its share of a byte rate. Bytes are paid for once
+// read, the thread then sleeps until the schedule has room for them. A
+// thread that fell behind catches up by at most 10 ms worth of bytes, so
+// a stall is not followed by a burst.
+class RatePacer {
+ public:
+  explicit RatePacer(double bytes_per_sec)
+      : ns_per_byte_(bytes_per_sec > 0.0 ? 1e9 / bytes_per_sec : 0.0),
+        next_(Clock::now()) {}
+
+  bool on() const { return ns_per_byte_ > 0.0; }
+
+  // Sleeps in short steps so that the end of the run is not overslept
+  void pay(size_t bytes, const RunControl &run) {
+    if (!on()) return;
+    next_ += std::chrono::nanoseconds(
+        static_cast<long long>(bytes * ns_per_byte_));
+    Clock::time_point now = Clock::now();
+    Clock::time_point floor = now - std::chrono::milliseconds(10);
+    if (next_ < floor) next_ = floor;
+    while (now < next_ && !run.stopped()) {
+      std::this_thread::sleep_until(
+          std::min(next_, now + std::chrono::milliseconds(10)));
+      now = Clock::now();
+    }
+  }
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  double ns_per_byte_;
+  Clock::time_point next_;
+};
+
+}  // namespace tps
+
+#endif  // RATE_LIMIT_HPP
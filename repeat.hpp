@@ -0,0 +1,252 @@
+#ifndef REPEAT_HPP
+#define REPEAT_HPP
+
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "file_read.hpp"
+#include "helper.hpp"
+#include "io_exception.hpp"
+#include "report.hpp"
+
+namespace tps {
+
+// Two-sided 95% quantile of Student's t distribution, rounded down to a
+// tabulated degree of freedom (30, 40, 60, 120) so intervals are never too
+// narrow
+static double t_quantile_95(double df) {
+  static const double table[] = {
+      12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+      2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+      2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+  if (df < 1.0) return table[0];
+  if (df < 31.0) return table[static_cast<int>(df) - 1];
+  if (df < 40.0) return table[29];
+  if (df < 60.0) return 2.021;
+  if (df < 120.0) return 2.000;
+  return 1.980;
+}
+
+// Mean, sample standard deviation and half width of the 95% confidence
+// interval of the mean over n runs
+struct Summary {
+  size_t n;
+  double mean;
+  double stddev;
+  double ci95;
+};
+
+static Summary summarize(const std::vector<double> &values) {
+  Summary s = {values.size(), 0.0, 0.0, 0.0};
+  if (values.empty()) return s;
+  for (double v : values) s.mean += v;
+  s.mean /= values.size();
+  if (values.size() < 2) return s;
+  double sq = 0.0;
+  for (double v : values) sq += (v - s.mean) * (v - s.mean);
+  s.stddev = std::sqrt(sq / (values.size() - 1));
+  s.ci95 = t_quantile_95(values.size() - 1) * s.stddev /
+           std::sqrt(static_cast<double>(values.size()));
+  return s;
+}
+
+// Welch's t-test of a result against its baseline. A change is significant
+// when the means differ by more than the 95% interval of their difference.
+// Without any variance, e.g. single runs, there is no interval and the
+// comparison is inconclusive.
+struct Comparison {
+  Summary base;
+  Summary now;
+  double change;  // relative to the baseline mean
+  bool conclusive;
+  bool significant;
+  bool regression;  // significant and in the worse direction
+};
+
+static Comparison compare(const Summary &base, const Summary &now,
+                          bool higher_is_better) {
+  Comparison c = {base, now, 0.0, false, false, false};
+  if (base.mean != 0.0) c.change = (now.mean - base.mean) / base.mean;
+  double vb = base.n > 1 ? base.stddev * base.stddev / base.n : 0.0;
+  double vn = now.n > 1 ? now.stddev * now.stddev / now.n : 0.0;
+  double se = std::sqrt(vb + vn);
+  if (se == 0.0) return c;
+  c.conclusive = true;
+  // Welch-Satterthwaite degrees of freedom
+  double df = (vb + vn) * (vb + vn) /
+              ((base.n > 1 ? vb * vb / (base.n - 1) : 0.0) +
+               (now.n > 1 ? vn * vn / (now.n - 1) : 0.0));
+  c.significant = std::fabs(now.mean - base.mean) / se > t_quantile_95(df);
+  c.regression =
+      c.significant && (higher_is_better ? now.mean < base.mean
+                                         : now.mean > base.mean);
+  return c;
+}
+
+// Results of the runs of one configuration, by metric. Throughputs are
+// better higher, latencies lower.
+class RepeatStats {
+ public:
+  void add_run(const FileRead &reader) {
+    add("bytes_per_sec",
+        to_bytes_per_sec(reader.total_bytes(), reader.total_time()));
+    add("ops_per_sec",
+        to_bytes_per_sec(reader.total_ops(), reader.total_time()));
+    if (!reader.has_latency()) return;
+    add("latency_p50_ns", reader.latency(0.5));
+    add("latency_p99_ns", reader.latency(0.99));
+    add("latency_p999_ns", reader.latency(0.999));
+  }
+
+  size_t runs() const { return values_.empty() ? 0 : values_[0].size(); }
+  const std::vector<std::string> &metrics() const { return names_; }
+  Summary summary(size_t metric) const { return summarize(values_[metric]); }
+  Summary bytes_per_sec() const { return summary(0); }
+  Summary ops_per_sec() const { return summary(1); }
+
+  static bool higher_is_better(const std::string &metric) {
+    return metric.compare(0, 8, "latency_") != 0;
+  }
+
+  // Line of the last run
+  void print_run(std::ostream &os) const {
+    os << "run: " << runs();
+    for (size_t m = 0; m < names_.size(); m++)
+      os << ", " << names_[m] << ": "
+         << static_cast<long long>(values_[m].back());
+    os << std::endl;
+  }
+
+  void print(std::ostream &os) const {
+    for (size_t m = 0; m < names_.size(); m++) {
+      Summary s = summary(m);
+      os << names_[m] << ": mean " << static_cast<long long>(s.mean)
+         << ", stddev " << static_cast<long long>(s.stddev) << ", 95% ci +-"
+         << static_cast<long long>(s.ci95) << " (+-"
+         << (s.mean == 0.0 ? 0.0 : 100.0 * s.ci95 / s.mean) << "%), runs "
+         << s.n << std::endl;
+    }
+  }
+
+  void add_results(Report *report) const {
+    report->add_result("runs", runs());
+    for (size_t m = 0; m < names_.size(); m++) {
+      Summary s = summary(m);
+      report->add_result(names_[m] + "_mean", std::llround(s.mean));
+      report->add_result(names_[m] + "_stddev", std::llround(s.stddev));
+      report->add_result(names_[m] + "_ci95", std::llround(s.ci95));
+    }
+  }
+
+ private:
+  void add(const std::string &metric, double value) {
+    size_t m = 0;
+    while (m < names_.size() && names_[m] != metric) m++;
+    if (m == names_.size()) {
+      names_.push_back(metric);
+      values_.emplace_back();
+    }
+    values_[m].push_back(value);
+  }
+
+  std::vector<std::string> names_;
+  std::vector<std::vector<double>> values_;
+};
+
+// Summaries saved by an earlier run, one "point metric n mean stddev" line
+// each. The point names the configuration within a sweep.
+class Baseline {
+ public:
+  void load(const std::string &path) {
+    std::ifstream fs(path);
+    if (!fs) throw IOException("Failed to open " + path);
+    std::string line;
+    while (std::getline(fs, line)) {
+      if (line.empty() || line[0] == '#') continue;
+      std::istringstream ss(line);
+      Entry e;
+      if (!(ss >> e.point >> e.metric >> e.summary.n >> e.summary.mean >>
+            e.summary.stddev))
+        throw IOException("Invalid baseline line: " + line);
+      e.summary.ci95 = e.summary.n < 2
+                           ? 0.0
+                           : t_quantile_95(e.summary.n - 1) *
+                                 e.summary.stddev / std::sqrt(e.summary.n);
+      entries_.push_back(e);
+    }
+  }
+
+  void save(const std::string &path) const {
+    std::ofstream fs(path, std::ios::out | std::ios::trunc);
+    if (!fs) throw IOException("Failed to create " + path);
+    fs.precision(17);
+    fs << "# point metric runs mean stddev" << std::endl;
+    for (const Entry &e : entries_)
+      fs << e.point << " " << e.metric << " " << e.summary.n << " "
+         << e.summary.mean << " " << e.summary.stddev << std::endl;
+    if (!fs) throw IOException("Failed to write " + path);
+  }
+
+  void add(const std::string &point, const RepeatStats &stats) {
+    for (size_t m = 0; m < stats.metrics().size(); m++)
+      entries_.push_back({point, stats.metrics()[m], stats.summary(m)});
+  }
+
+  bool find(const std::string &point, const std::string &metric,
+            Summary *summary) const {
+    for (const Entry &e : entries_) {
+      if (e.point == point && e.metric == metric) {
+        *summary = e.summary;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Prints and reports the metrics of stats that the baseline has, returns
+  // how many of them regressed
+  size_t compare_to(const std::string &point, const RepeatStats &stats,
+                    std::ostream *os, Report *report) const {
+    size_t regressions = 0;
+    for (size_t m = 0; m < stats.metrics().size(); m++) {
+      const std::string &metric = stats.metrics()[m];
+      Summary base;
+      if (!find(point, metric, &base)) continue;
+      Comparison c = compare(base, stats.summary(m),
+                             RepeatStats::higher_is_better(metric));
+      if (c.regression) regressions++;
+      const char *verdict = !c.conclusive    ? "inconclusive, no variance"
+                            : !c.significant ? "within noise"
+                            : c.regression ? "regression"
+                                           : "improvement";
+      if (os)
+        *os << metric << ": baseline " << static_cast<long long>(base.mean)
+            << ", now " << static_cast<long long>(c.now.mean) << ", change "
+            << 100.0 * c.change << "%, " << verdict << std::endl;
+      if (report) {
+        report->add_result(metric + "_baseline_mean", std::llround(base.mean));
+        report->add_ratio(metric + "_change", c.change);
+        report->add_result(metric + "_significant", c.significant ? 1 : 0);
+        report->add_result(metric + "_regression", c.regression ? 1 : 0);
+      }
+    }
+    return regressions;
+  }
+
+ private:
+  struct Entry {
+    std::string point;
+    std::string metric;
+    Summary summary;
+  };
+
+  std::vector<Entry> entries_;
+};
+
+}  // namespace tps
+
+#endif  // REPEAT_HPP
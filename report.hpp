@@ -0,0 +1,155 @@
+#ifndef REPORT_HPP
+#define REPORT_HPP
+
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "helper.hpp"
+
+namespace tps {
+
+// Format of the results. TEXT is the human readable default, JSON and CSV
+// carry raw integers for machines.
+enum class Output { TEXT, JSON, CSV };
+
+static bool parse_output(const std::string &str, Output *output) {
+  std::string value = to_lower(str);
+  if (value.compare("text") == 0)
+    *output = Output::TEXT;
+  else if (value.compare("json") == 0)
+    *output = Output::JSON;
+  else if (value.compare("csv") == 0)
+    *output = Output::CSV;
+  else
+    return false;
+  return true;
+}
+
+// What one worker thread did
+struct ThreadStats {
+  int thread;
+  size_t ops;
+  size_t bytes;
+  size_t records;
+  size_t files;
+  long long time;
+};
+
+typedef std::vector<std::pair<std::string, std::string>> Arguments;
+
+// Collects arguments, aggregate results and per-thread stats of a run and
+// prints them as JSON or CSV.
+class Report {
+ public:
+  explicit Report(const Arguments &arguments) : arguments_(arguments) {}
+
+  void add_result(const std::string &key, long long value) {
+    results_.push_back({key, std::to_string(value)});
+  }
+
+  // Non-integer result such as a count per operation
+  void add_ratio(const std::string &key, double value) {
+    std::ostringstream ss;
+    ss << value;
+    results_.push_back({key, ss.str()});
+  }
+
+  void add_threads(const std::vector<ThreadStats> &threads) {
+    threads_.insert(threads_.end(), threads.begin(), threads.end());
+  }
+
+  // JSON object with "arguments", "results" and "threads"
+  void print_json(std::ostream &os) const {
+    os << "{" << std::endl << "  \"arguments\": {";
+    for (size_t i = 0; i < arguments_.size(); i++)
+      os << (i == 0 ? "" : ",") << std::endl
+         << "    " << quote_json(arguments_[i].first) << ": "
+         << (is_integer(arguments_[i].second)
+                 ? arguments_[i].second
+                 : quote_json(arguments_[i].second));
+    os << std::endl << "  }," << std::endl << "  \"results\": {";
+    for (size_t i = 0; i < results_.size(); i++)
+      os << (i == 0 ? "" : ",") << std::endl
+         << "    " << quote_json(results_[i].first) << ": "
+         << results_[i].second;
+    os << std::endl << "  }," << std::endl << "  \"threads\": [";
+    for (size_t i = 0; i < threads_.size(); i++) {
+      const ThreadStats &t = threads_[i];
+      os << (i == 0 ? "" : ",") << std::endl
+         << "    {\"thread\": " << t.thread << ", \"ops\": " << t.ops
+         << ", \"bytes\": " << t.bytes << ", \"records\": " << t.records
+         << ", \"files\": " << t.files << ", \"time_ns\": " << t.time << "}";
+    }
+    os << std::endl << "  ]" << std::endl << "}" << std::endl;
+  }
+
+  // One row per thread and a last "all" row with the results, every row
+  // repeats the arguments so that rows of several runs can be concatenated
+  void print_csv(std::ostream &os, bool header) const {
+    if (header) {
+      for (const auto &arg : arguments_) os << quote_csv(arg.first) << ",";
+      os << "thread,ops,bytes,records,files,time_ns";
+      for (const auto &result : results_)
+        os << "," << quote_csv(result.first);
+      os << std::endl;
+    }
+
+    for (const ThreadStats &t : threads_) {
+      for (const auto &arg : arguments_) os << quote_csv(arg.second) << ",";
+      os << t.thread << "," << t.ops << "," << t.bytes << "," << t.records
+         << "," << t.files << "," << t.time;
+      for (size_t i = 0; i < results_.size(); i++) os << ",";
+      os << std::endl;
+    }
+
+    for (const auto &arg : arguments_) os << quote_csv(arg.second) << ",";
+    os << "all,,,,,";
+    for (const auto &result : results_) os << "," << result.second;
+    os << std::endl;
+  }
+
+ private:
+  static std::string quote_json(const std::string &str) {
+    std::string ret = "\"";
+    for (char c : str) {
+      if (c == '"' || c == '\\') {
+        ret += '\\';
+        ret += c;
+      } else if (static_cast<unsigned char>(c) < 0x20) {
+        char buf[8];
+        snprintf(buf, sizeof(buf), "\\u%04x", c);
+        ret += buf;
+      } else {
+        ret += c;
+      }
+    }
+    return ret + "\"";
+  }
+
+  static bool is_integer(const std::string &str) {
+    return !str.empty() && str.size() < 19 &&
+           str.find_first_not_of("0123456789") == std::string::npos;
+  }
+
+  static std::string quote_csv(const std::string &str) {
+    if (str.find_first_of(",\"\n") == std::string::npos) return str;
+    std::string ret = "\"";
+    for (char c : str) {
+      if (c == '"') ret += '"';
+      ret += c;
+    }
+    return ret + "\"";
+  }
+
+  Arguments arguments_;
+  Arguments results_;
+  std::vector<ThreadStats> threads_;
+};
+
+}  // namespace tps
+
+#endif  // REPORT_HPP
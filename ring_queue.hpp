@@ -0,0 +1,92 @@
+#ifndef RING_QUEUE_HPP
+#define RING_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace tps {
+
+// Bounded lock-free multi-producer multi-consumer queue. Each cell carries a
+// sequence number that tells producers and consumers whose turn it is, so
+// push() and pop() never block and fail only when the queue is full or empty.
+template <typename T>
+class RingQueue {
+ public:
+  explicit RingQueue(size_t capacity) : head_(0), tail_(0) {
+    size_t size = 2;
+    while (size < capacity) size <<= 1;
+    mask_ = size - 1;
+    cells_.reset(new Cell[size]);
+    for (size_t i = 0; i < size; i++)
+      cells_[i].seq.store(i, std::memory_order_relaxed);
+  }
+
+  bool push(const T &value) {
+    Cell *cell;
+    size_t pos = tail_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells_[pos & mask_];
+      size_t seq = cell->seq.load(std::memory_order_acquire);
+      intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (dif == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed))
+          break;
+      } else if (dif < 0) {
+        return false;
+      } else {
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value = value;
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T *value) {
+    Cell *cell;
+    size_t pos = head_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells_[pos & mask_];
+      size_t seq = cell->seq.load(std::memory_order_acquire);
+      intptr_t dif =
+          static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+      if (dif == 0) {
+        if (head_.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed))
+          break;
+      } else if (dif < 0) {
+        return false;
+      } else {
+        pos = head_.load(std::memory_order_relaxed);
+      }
+    }
+    *value = cell->value;
+    cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+    return true;
+  }
+
+  size_t capacity() const { return mask_ + 1; }
+
+ private:
+  static constexpr size_t CACHE_LINE = 64;
+
+  struct Cell {
+    std::atomic<size_t> seq;
+    T value;
+  };
+
+  std::unique_ptr<Cell[]> cells_;
+  size_t mask_;
+  char pad0_[CACHE_LINE];
+  std::atomic<size_t> head_;
+  char pad1_[CACHE_LINE];
+  std::atomic<size_t> tail_;
+  char pad2_[CACHE_LINE];
+};
+
+}  // namespace tps
+
+#endif  // RING_QUEUE_HPP
@@ -0,0 +1,82 @@
+#ifndef RUN_CONTROL_HPP
+#define RUN_CONTROL_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace tps {
+
+// Ends a run at its deadline. A watchdog thread sleeps until max_time after
+// arm() and then sets the stop flag, so the workers only load a flag per
+// operation instead of reading the clock.
+class RunControl {
+ public:
+  RunControl()
+      : stop_(false), armed_(false), has_deadline_(false), quit_(false) {}
+
+  ~RunControl() { finish(); }
+
+  RunControl(const RunControl &) = delete;
+  RunControl &operator=(const RunControl &) = delete;
+
+  void start() {
+    stop_ = false;
+    armed_ = false;
+    has_deadline_ = false;
+    quit_ = false;
+    watchdog_ = std::thread(&RunControl::run, this);
+  }
+
+  // Starts the max_time window from now. Only the first call counts, e.g.
+  // the first worker that leaves warm-up.
+  void arm(long long max_time) {
+    if (armed_.load(std::memory_order_relaxed) ||
+        armed_.exchange(true, std::memory_order_relaxed))
+      return;
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      deadline_ =
+          std::chrono::steady_clock::now() + std::chrono::nanoseconds(max_time);
+      has_deadline_ = true;
+    }
+    cv_.notify_all();
+  }
+
+  bool stopped() const { return stop_.load(std::memory_order_relaxed); }
+
+  // Stop the watchdog, the flag keeps its value
+  void finish() {
+    if (!watchdog_.joinable()) return;
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      quit_ = true;
+    }
+    cv_.notify_all();
+    watchdog_.join();
+  }
+
+ private:
+  void run() {
+    std::unique_lock<std::mutex> lock(mtx_);
+    cv_.wait(lock, [this] { return quit_ || has_deadline_; });
+    if (quit_) return;
+    if (!cv_.wait_until(lock, deadline_, [this] { return quit_; }))
+      stop_.store(true, std::memory_order_relaxed);
+  }
+
+  std::atomic<bool> stop_;
+  std::atomic<bool> armed_;
+  bool has_deadline_;
+  bool quit_;
+  std::chrono::steady_clock::time_point deadline_;
+  std::thread watchdog_;
+  std::mutex mtx_;
+  std::condition_variable cv_;
+};
+
+}  // namespace tps
+
+#endif  // RUN_CONTROL_HPP
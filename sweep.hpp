@@ -0,0 +1,115 @@
+#ifndef SWEEP_HPP
+#define SWEEP_HPP
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "helper.hpp"
+
+namespace tps {
+
+// Values of a sweep key: "n", "m,n,..." or "lo..hi" stepped by "*f" or
+// "+s", e.g. 1..64*2 or 4KB..1MB. A range without a step doubles. Values
+// are sorted and unique.
+static bool parse_range(const std::string &str, bool bytes,
+                        std::vector<size_t> *values) {
+  auto to_value = [bytes](const std::string &s) {
+    return bytes ? size_in_bytes(s) : to_size_t(s);
+  };
+  values->clear();
+  try {
+    size_t dots = str.find("..");
+    if (dots == std::string::npos) {
+      std::stringstream ss(str);
+      std::string value;
+      while (std::getline(ss, value, ',')) values->push_back(to_value(value));
+    } else {
+      std::string hi = str.substr(dots + 2);
+      char op = '*';
+      size_t step = 2;
+      size_t sidx = hi.find_first_of("*+");
+      if (sidx != std::string::npos) {
+        op = hi[sidx];
+        step = to_size_t(hi.substr(sidx + 1));
+        hi = hi.substr(0, sidx);
+      }
+      size_t lo_value = to_value(str.substr(0, dots));
+      size_t hi_value = to_value(hi);
+      if (lo_value == 0 || (op == '*' && step < 2) || (op == '+' && step == 0))
+        return false;
+      for (size_t v = lo_value; v <= hi_value; v = op == '*' ? v * step
+                                                             : v + step)
+        values->push_back(v);
+    }
+  } catch (const std::exception &) {
+    return false;
+  }
+  std::sort(values->begin(), values->end());
+  values->erase(std::unique(values->begin(), values->end()), values->end());
+  return !values->empty();
+}
+
+// Throughput of every point of a sweep. Points with the same record size
+// and depth form a group whose first point, the one with the fewest
+// workers, is the base of the speedup and efficiency of the others.
+class ScalingTable {
+ public:
+  struct Point {
+    size_t record_size;
+    size_t depth;
+    int workers;
+    size_t ops_per_sec;
+    size_t bytes_per_sec;
+    double speedup;
+    double efficiency;
+  };
+
+  // Adds the point and returns it with speedup and efficiency filled in
+  const Point &add(size_t record_size, size_t depth, int workers,
+                   size_t ops_per_sec, size_t bytes_per_sec) {
+    Point p = {record_size, depth,  workers, ops_per_sec,
+               bytes_per_sec, 1.0, 1.0};
+    if (base_ < points_.size() && points_[base_].record_size == record_size &&
+        points_[base_].depth == depth) {
+      const Point &b = points_[base_];
+      if (b.bytes_per_sec > 0) {
+        p.speedup = 1.0 * bytes_per_sec / b.bytes_per_sec;
+        p.efficiency = p.speedup * b.workers / workers;
+      }
+    } else {
+      base_ = points_.size();
+    }
+    points_.push_back(p);
+    return points_.back();
+  }
+
+  size_t size() const { return points_.size(); }
+
+  void print(std::ostream &os, bool with_depth) const {
+    os << std::setw(12) << "record-size";
+    if (with_depth) os << std::setw(7) << "depth";
+    os << std::setw(9) << "workers" << std::setw(14) << "ops/sec"
+       << std::setw(16) << "bytes/sec" << std::setw(9) << "speedup"
+       << std::setw(11) << "efficiency" << std::endl;
+    for (const Point &p : points_) {
+      os << std::setw(12) << p.record_size;
+      if (with_depth) os << std::setw(7) << p.depth;
+      os << std::setw(9) << p.workers << std::setw(14) << p.ops_per_sec
+         << std::setw(16) << p.bytes_per_sec << std::fixed
+         << std::setprecision(2) << std::setw(9) << p.speedup
+         << std::setw(11) << p.efficiency << std::defaultfloat << std::endl;
+    }
+  }
+
+ private:
+  std::vector<Point> points_;
+  size_t base_ = 0;
+};
+
+}  // namespace tps
+
+#endif  // SWEEP_HPP
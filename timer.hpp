@@ -3,8 +3,11 @@
 
 #ifdef _WIN32
 #include <windows.h>
-#else
+#endif
 #include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
 #endif
 #include <time.h>
 
@@ -138,6 +141,81 @@ class LowResTimer : public Timer {
   clock_t end_;
 };
 
+// Timer on the time stamp counter, a few ns per stop() instead of a clock
+// call. Ticks are calibrated against steady_clock once per process. Without
+// an invariant TSC it reads steady_clock.
+class TscTimer : public Timer {
+ public:
+  explicit TscTimer() : start_(0), end_(0) {}
+  ~TscTimer() {}
+
+  void start() { start_ = now(); }
+
+  void stop() { end_ = now(); }
+
+  long long elapsed_ns() const {
+    return static_cast<long long>((end_ - start_) * ns_per_tick());
+  }
+
+  long long elapsed_us() const { return elapsed_ns() / 1000; }
+
+  long long elapsed_ms() const { return elapsed_ns() / 1000000; }
+
+  long long elapsed_s() const { return elapsed_ns() / 1000000000; }
+
+  // True if the counter is used, false if it falls back to steady_clock
+  static bool invariant() {
+    static const bool inv = has_invariant_tsc();
+    return inv;
+  }
+
+  static double ns_per_tick() {
+    static const double ns = calibrate();
+    return ns;
+  }
+
+ private:
+  static unsigned long long now() {
+#if defined(__x86_64__) || defined(__i386__)
+    if (invariant()) return __rdtsc();
+#endif
+    return static_cast<unsigned long long>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+  }
+
+  static bool has_invariant_tsc() {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) == 0 ||
+        eax < 0x80000007)
+      return false;
+    __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    return (edx & (1u << 8)) != 0;
+#else
+    return false;
+#endif
+  }
+
+  // Ticks over 10 ms of steady_clock
+  static double calibrate() {
+    if (!invariant()) return 1.0;
+    auto t0 = std::chrono::steady_clock::now();
+    unsigned long long c0 = now();
+    auto t1 = t0;
+    while (t1 - t0 < std::chrono::milliseconds(10))
+      t1 = std::chrono::steady_clock::now();
+    unsigned long long c1 = now();
+    long long ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+    return c1 > c0 ? 1.0 * ns / (c1 - c0) : 1.0;
+  }
+
+  unsigned long long start_;
+  unsigned long long end_;
+};
+
 }  // namespace files
 
 #endif  // TIMER_HPP
\ No newline at end of file
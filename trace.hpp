@@ -0,0 +1,215 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "file_list.hpp"
+#include "io_exception.hpp"
+
+namespace tps {
+
+// Binary trace of the reads issued by a run. The file and directory tables
+// come first so a record names its file by index.
+//   header, num_dirs {u32 len, name}, num_files {u32 dir, u64 size,
+//   u32 len, name}, num_records records
+struct TraceHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  uint64_t num_dirs;
+  uint64_t num_files;
+  uint64_t num_records;
+};
+
+// READ is one positioned read of a lookup, SCAN a range streamed in chunks
+enum TraceOp : uint8_t { TRACE_READ = 0, TRACE_SCAN = 1 };
+
+// Time is since the start of the recorded run. A full scan of a large
+// file is one record, so its length takes 64 bits.
+struct TraceRecord {
+  uint64_t time_ns;
+  uint64_t offset;
+  uint64_t length;
+  uint32_t file;
+  uint16_t thread;
+  uint8_t op;
+  uint8_t reserved;
+};
+
+static const char TRACE_MAGIC[8] = {'T', 'P', 'S', 'T', 'R', 'A', 'C', 'E'};
+static const uint32_t TRACE_VERSION = 2;
+
+// Records of one worker, timestamps are taken against a start shared by
+// all workers of the run
+class TraceLog {
+ public:
+  TraceLog(bool on, std::chrono::steady_clock::time_point start, int thread)
+      : on_(on), start_(start), thread_(static_cast<uint16_t>(thread)) {
+    if (on_) records_.reserve(1 << 16);
+  }
+
+  bool on() const { return on_; }
+
+  void add(TraceOp op, size_t file, size_t offset, size_t length) {
+    TraceRecord r;
+    memset(&r, 0, sizeof(r));
+    r.time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start_)
+                    .count();
+    r.offset = offset;
+    r.length = length;
+    r.file = static_cast<uint32_t>(file);
+    r.thread = thread_;
+    r.op = op;
+    records_.push_back(r);
+  }
+
+  std::vector<TraceRecord> &records() { return records_; }
+
+ private:
+  bool on_;
+  std::chrono::steady_clock::time_point start_;
+  uint16_t thread_;
+  std::vector<TraceRecord> records_;
+};
+
+struct Trace {
+  std::vector<std::string> dirs;
+  std::vector<std::string> files;
+  std::vector<uint32_t> file_dirs;
+  std::vector<size_t> file_sizes;
+  std::vector<TraceRecord> records;  // by time
+
+  // Records of all workers merged by time
+  void write(const std::string &path) {
+    std::stable_sort(records.begin(), records.end(),
+                     [](const TraceRecord &a, const TraceRecord &b) {
+                       return a.time_ns < b.time_ns;
+                     });
+    TraceHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(TraceRecord);
+    header.num_dirs = dirs.size();
+    header.num_files = files.size();
+    header.num_records = records.size();
+
+    std::ofstream fs(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!fs) throw IOException("Failed to create " + path);
+    auto put = [&fs](const void *data, size_t len) {
+      fs.write(static_cast<const char *>(data), len);
+    };
+    auto put_name = [&put](const std::string &name) {
+      uint32_t len = static_cast<uint32_t>(name.size());
+      put(&len, sizeof(len));
+      put(name.data(), len);
+    };
+    put(&header, sizeof(header));
+    for (const std::string &d : dirs) put_name(d);
+    for (size_t i = 0; i < files.size(); i++) {
+      uint32_t dir = file_dirs[i];
+      uint64_t size = file_sizes[i];
+      put(&dir, sizeof(dir));
+      put(&size, sizeof(size));
+      put_name(files[i]);
+    }
+    put(records.data(), records.size() * sizeof(TraceRecord));
+    fs.flush();
+    if (!fs) throw IOException("Failed to write " + path);
+  }
+
+  static std::shared_ptr<const Trace> load(const std::string &path) {
+    std::ifstream fs(path, std::ios::in | std::ios::binary);
+    if (!fs) throw IOException("Failed to open " + path);
+    std::shared_ptr<Trace> trace = std::make_shared<Trace>();
+    auto get = [&fs, &path](void *data, size_t len) {
+      if (!fs.read(static_cast<char *>(data), len))
+        throw IOException("Truncated trace: " + path);
+    };
+    auto get_name = [&get](std::string *name) {
+      uint32_t len;
+      get(&len, sizeof(len));
+      name->resize(len);
+      if (len > 0) get(&(*name)[0], len);
+    };
+
+    TraceHeader header;
+    get(&header, sizeof(header));
+    if (memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != TRACE_VERSION ||
+        header.record_size != sizeof(TraceRecord) || header.num_dirs == 0 ||
+        header.num_dirs > FileList::MAX_DIRS || header.num_files == 0)
+      throw IOException("Invalid trace: " + path);
+
+    trace->dirs.resize(header.num_dirs);
+    for (std::string &d : trace->dirs) get_name(&d);
+    trace->files.resize(header.num_files);
+    trace->file_dirs.resize(header.num_files);
+    trace->file_sizes.resize(header.num_files);
+    for (size_t i = 0; i < header.num_files; i++) {
+      uint64_t size;
+      get(&trace->file_dirs[i], sizeof(uint32_t));
+      get(&size, sizeof(size));
+      get_name(&trace->files[i]);
+      if (trace->file_dirs[i] >= header.num_dirs ||
+          (i > 0 && trace->file_dirs[i] < trace->file_dirs[i - 1]))
+        throw IOException("Invalid trace: " + path);
+      trace->file_sizes[i] = size;
+    }
+    std::streampos records_pos = fs.tellg();
+    fs.seekg(0, std::ios::end);
+    if (static_cast<uint64_t>(fs.tellg() - records_pos) !=
+        header.num_records * sizeof(TraceRecord))
+      throw IOException("Invalid trace: " + path);
+    fs.seekg(records_pos);
+    trace->records.resize(header.num_records);
+    get(trace->records.data(), header.num_records * sizeof(TraceRecord));
+    for (const TraceRecord &r : trace->records) {
+      if (r.file >= header.num_files || r.op > TRACE_SCAN)
+        throw IOException("Invalid trace: " + path);
+    }
+    return trace;
+  }
+
+  // Files of the trace, in dir_list if given instead of the recorded
+  // directories, which must then be as many
+  std::shared_ptr<const FileList> file_list(
+      const std::string &dir_list) const {
+    std::shared_ptr<FileList> list = std::make_shared<FileList>();
+    list->dirs = dir_list.empty() ? dirs : split_dirs(dir_list);
+    if (list->dirs.size() != dirs.size())
+      throw IOException("The trace has " + std::to_string(dirs.size()) +
+                        " directories, " + std::to_string(list->dirs.size()) +
+                        " given");
+    for (size_t d = 0; d < list->dirs.size(); d++) {
+      if (d > 0) list->dir += ",";
+      list->dir += list->dirs[d];
+    }
+    list->files = files;
+    list->file_sizes = file_sizes;
+    list->file_dirs = file_dirs;
+    // Files were recorded grouped by directory, as in the reader's list
+    list->dir_begin.assign(list->dirs.size() + 1, 0);
+    for (uint32_t d : file_dirs) list->dir_begin[d + 1]++;
+    for (size_t d = 0; d < list->dirs.size(); d++)
+      list->dir_begin[d + 1] += list->dir_begin[d];
+    return list;
+  }
+
+  // Time of the last record
+  long long duration() const {
+    return records.empty() ? 0 : static_cast<long long>(records.back().time_ns);
+  }
+};
+
+}  // namespace tps
+
+#endif  // TRACE_HPP
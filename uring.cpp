@@ -0,0 +1,303 @@
+#include "uring.hpp"
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "io_exception.hpp"
+
+namespace tps {
+
+static const unsigned MAX_ENTRIES = 32768;
+
+Uring::Uring(unsigned entries)
+    : ring_fd_(-1),
+      sq_entries_(0),
+      to_submit_(0),
+      sq_ptr_(MAP_FAILED),
+      sq_size_(0),
+      cq_ptr_(MAP_FAILED),
+      cq_size_(0),
+      sqes_(static_cast<struct io_uring_sqe *>(MAP_FAILED)),
+      sqes_size_(0) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  entries = std::max(1u, std::min(entries, MAX_ENTRIES));
+  ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+  if (ring_fd_ < 0)
+    throw IOException("Failed to set up io_uring, error " +
+                      std::to_string(errno));
+  sq_entries_ = p.sq_entries;
+
+  sq_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  cq_size_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    sq_size_ = std::max(sq_size_, cq_size_);
+    cq_size_ = sq_size_;
+  }
+
+  sq_ptr_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+  if (sq_ptr_ == MAP_FAILED) {
+    close(ring_fd_);
+    throw IOException("Failed to map io_uring, error " +
+                      std::to_string(errno));
+  }
+  if (single_mmap) {
+    cq_ptr_ = sq_ptr_;
+  } else {
+    cq_ptr_ = mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+    if (cq_ptr_ == MAP_FAILED) {
+      munmap(sq_ptr_, sq_size_);
+      close(ring_fd_);
+      throw IOException("Failed to map io_uring, error " +
+                        std::to_string(errno));
+    }
+  }
+  sqes_size_ = p.sq_entries * sizeof(struct io_uring_sqe);
+  sqes_ = static_cast<struct io_uring_sqe *>(
+      mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES));
+  if (sqes_ == MAP_FAILED) {
+    if (!single_mmap) munmap(cq_ptr_, cq_size_);
+    munmap(sq_ptr_, sq_size_);
+    close(ring_fd_);
+    throw IOException("Failed to map io_uring, error " +
+                      std::to_string(errno));
+  }
+
+  char *sq = static_cast<char *>(sq_ptr_);
+  sq_head_ = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+  sq_tail_ = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+  sq_mask_ = reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+  sq_array_ = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+  char *cq = static_cast<char *>(cq_ptr_);
+  cq_head_ = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+  cq_mask_ = reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<struct io_uring_cqe *>(cq + p.cq_off.cqes);
+}
+
+Uring::~Uring() {
+  munmap(sqes_, sqes_size_);
+  if (cq_ptr_ != sq_ptr_) munmap(cq_ptr_, cq_size_);
+  munmap(sq_ptr_, sq_size_);
+  close(ring_fd_);
+}
+
+bool Uring::register_buffers(const std::vector<struct iovec> &iovs) {
+  return syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_BUFFERS,
+                 iovs.data(), static_cast<unsigned>(iovs.size())) == 0;
+}
+
+bool Uring::prep_read(int fd, void *buf, unsigned len, uint64_t offset,
+                      int buf_index, uint64_t user_data) {
+  unsigned tail = *sq_tail_;
+  unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+  if (tail - head >= sq_entries_) return false;
+
+  unsigned idx = tail & *sq_mask_;
+  struct io_uring_sqe *sqe = &sqes_[idx];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = buf_index < 0 ? IORING_OP_READ : IORING_OP_READ_FIXED;
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<uint64_t>(buf);
+  sqe->len = len;
+  sqe->off = offset;
+  if (buf_index >= 0) sqe->buf_index = static_cast<uint16_t>(buf_index);
+  sqe->user_data = user_data;
+  sq_array_[idx] = idx;
+  __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+  to_submit_++;
+  return true;
+}
+
+int Uring::submit(unsigned min_complete) {
+  if (to_submit_ == 0 && min_complete == 0) return 0;
+  unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+  while (true) {
+    long ret = syscall(__NR_io_uring_enter, ring_fd_, to_submit_,
+                       min_complete, flags, nullptr, 0);
+    if (ret >= 0) {
+      to_submit_ -= std::min(to_submit_, static_cast<unsigned>(ret));
+      return static_cast<int>(ret);
+    }
+    if (errno != EINTR)
+      throw IOException("Failed to submit to io_uring, error " +
+                        std::to_string(errno));
+  }
+}
+
+bool Uring::peek(uint64_t *user_data, int *res) {
+  unsigned head = *cq_head_;
+  unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+  if (head == tail) return false;
+  struct io_uring_cqe *cqe = &cqes_[head & *cq_mask_];
+  *user_data = cqe->user_data;
+  *res = cqe->res;
+  __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+UringReader::UringReader(size_t depth, size_t max_streams, size_t chunk_size,
+                         size_t io_align, HugePages huge_pages,
+                         size_t mem_align)
+    : depth_(std::max<size_t>(1, depth)),
+      chunk_size_(chunk_size),
+      io_align_(io_align),
+      huge_pages_(huge_pages),
+      mem_align_(mem_align),
+      fixed_(false),
+      ring_(static_cast<unsigned>(std::max<size_t>(1, depth) *
+                                  std::max<size_t>(1, max_streams))),
+      last_slot_(-1),
+      last_stream_(-1) {
+  max_streams = std::max<size_t>(1, max_streams);
+  // The kernel caps the ring, every stream still gets a slot of its own
+  if (ring_.entries() < max_streams)
+    throw IOException("io_uring has " + std::to_string(ring_.entries()) +
+                      " entries, too few for " +
+                      std::to_string(max_streams) + " open files");
+  depth_ = std::min<size_t>(depth_, ring_.entries() / max_streams);
+  size_t num_slots = depth_ * max_streams;
+
+  std::vector<struct iovec> iovs(num_slots);
+  bufs_.resize(num_slots);
+  slots_.resize(num_slots);
+  free_slots_.reserve(num_slots);
+  for (size_t i = 0; i < num_slots; i++) {
+    bufs_[i] = alloc_buffer(chunk_size_, huge_pages_, mem_align_);
+    iovs[i].iov_base = bufs_[i];
+    iovs[i].iov_len = chunk_size_;
+    free_slots_.push_back(num_slots - 1 - i);
+  }
+  // Fixed buffers count against RLIMIT_MEMLOCK, fall back to plain reads
+  fixed_ = num_slots <= UIO_MAXIOV && ring_.register_buffers(iovs);
+
+  streams_.resize(max_streams);
+  for (Stream &st : streams_) {
+    st.fd = -1;
+    st.slots.resize(depth_);
+  }
+}
+
+UringReader::~UringReader() {
+  for (size_t i = 0; i < streams_.size(); i++)
+    if (streams_[i].fd != -1) close_stream(streams_[i].fd);
+  for (char *ptr : bufs_) free_buffer(ptr, chunk_size_, huge_pages_);
+}
+
+int UringReader::find_stream(int fd) const {
+  for (size_t i = 0; i < streams_.size(); i++)
+    if (streams_[i].fd == fd) return static_cast<int>(i);
+  return -1;
+}
+
+void UringReader::submit_chunk(size_t stream_idx, size_t slot) {
+  Stream &st = streams_[stream_idx];
+  slots_[slot].stream = static_cast<int>(stream_idx);
+  slots_[slot].done = false;
+  slots_[slot].res = 0;
+  size_t len = std::min(chunk_size_, st.end - st.next);
+  if (io_align_ > 1)
+    len = std::min(chunk_size_, (len + io_align_ - 1) / io_align_ * io_align_);
+  while (!ring_.prep_read(st.fd, bufs_[slot], static_cast<unsigned>(len),
+                          st.next, fixed_ ? static_cast<int>(slot) : -1,
+                          slot))
+    ring_.submit(0);
+  st.next += len;
+  st.slots[(st.head + st.count) % depth_] = slot;
+  st.count++;
+}
+
+void UringReader::reap(unsigned min_complete) {
+  ring_.submit(min_complete);
+  uint64_t slot;
+  int res;
+  while (ring_.peek(&slot, &res)) {
+    slots_[slot].done = true;
+    slots_[slot].res = res;
+  }
+}
+
+void UringReader::open_stream(int fd, size_t pos, size_t len) {
+  int si = find_stream(-1);
+  if (si < 0) throw IOException("Too many io_uring streams");
+  Stream &st = streams_[si];
+  st.fd = fd;
+  st.next = pos;
+  st.end = pos + len;
+  st.head = 0;
+  st.count = 0;
+  while (st.count < depth_ && st.next < st.end && !free_slots_.empty()) {
+    size_t slot = free_slots_.back();
+    free_slots_.pop_back();
+    submit_chunk(si, slot);
+  }
+  ring_.submit(0);
+}
+
+size_t UringReader::read(int fd, const char **data) {
+  // Recycle the buffer handed out by the previous call
+  if (last_slot_ >= 0) {
+    Stream &prev = streams_[last_stream_];
+    if (prev.fd != -1 && prev.next < prev.end)
+      submit_chunk(last_stream_, static_cast<size_t>(last_slot_));
+    else
+      free_slots_.push_back(static_cast<size_t>(last_slot_));
+    last_slot_ = -1;
+  }
+
+  int si = find_stream(fd);
+  if (si < 0 || streams_[si].count == 0) {
+    ring_.submit(0);
+    return 0;
+  }
+  Stream &st = streams_[si];
+  size_t slot = st.slots[st.head];
+  if (slots_[slot].done)
+    ring_.submit(0);
+  else
+    while (!slots_[slot].done) reap(1);
+  st.head = (st.head + 1) % depth_;
+  st.count--;
+
+  int res = slots_[slot].res;
+  if (res <= 0) {
+    free_slots_.push_back(slot);
+    if (res == 0) return 0;
+    errno = -res;
+    return (size_t)-1;
+  }
+  *data = bufs_[slot];
+  last_slot_ = static_cast<long long>(slot);
+  last_stream_ = si;
+  return static_cast<size_t>(res);
+}
+
+void UringReader::close_stream(int fd) {
+  int si = find_stream(fd);
+  if (si < 0) return;
+  Stream &st = streams_[si];
+  if (last_slot_ >= 0 && last_stream_ == si) {
+    free_slots_.push_back(static_cast<size_t>(last_slot_));
+    last_slot_ = -1;
+  }
+  while (st.count > 0) {
+    size_t slot = st.slots[st.head];
+    while (!slots_[slot].done) reap(1);
+    free_slots_.push_back(slot);
+    st.head = (st.head + 1) % depth_;
+    st.count--;
+  }
+  st.fd = -1;
+}
+
+}  // namespace tps
@@ -0,0 +1,120 @@
+#ifndef URING_HPP
+#define URING_HPP
+
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "buffer.hpp"
+
+namespace tps {
+
+// Minimal io_uring wrapper on top of the raw system calls
+class Uring {
+ public:
+  explicit Uring(unsigned entries);
+  ~Uring();
+
+  Uring(const Uring &) = delete;
+  Uring &operator=(const Uring &) = delete;
+
+  // Register buffers for READ_FIXED, return false if the kernel refuses
+  bool register_buffers(const std::vector<struct iovec> &iovs);
+
+  // Queue a read, a negative buf_index queues a plain read
+  bool prep_read(int fd, void *buf, unsigned len, uint64_t offset,
+                 int buf_index, uint64_t user_data);
+
+  // Submit queued reads and wait for at least min_complete completions
+  int submit(unsigned min_complete);
+
+  // Pop one completion if available
+  bool peek(uint64_t *user_data, int *res);
+
+  unsigned entries() const { return sq_entries_; }
+
+ private:
+  int ring_fd_;
+  unsigned sq_entries_;
+  unsigned to_submit_;
+
+  void *sq_ptr_;
+  size_t sq_size_;
+  void *cq_ptr_;
+  size_t cq_size_;
+  struct io_uring_sqe *sqes_;
+  size_t sqes_size_;
+
+  unsigned *sq_head_;
+  unsigned *sq_tail_;
+  unsigned *sq_mask_;
+  unsigned *sq_array_;
+  unsigned *cq_head_;
+  unsigned *cq_tail_;
+  unsigned *cq_mask_;
+  struct io_uring_cqe *cqes_;
+};
+
+// Reads a set of sequential streams through io_uring, keeping up to depth
+// chunks of each stream in flight in registered buffers. The last chunk of
+// a stream is cut to its end, rounded up to io_align for O_DIRECT.
+class UringReader {
+ public:
+  UringReader(size_t depth, size_t max_streams, size_t chunk_size,
+              size_t io_align, HugePages huge_pages, size_t mem_align);
+  ~UringReader();
+
+  // Start streaming [pos, pos + len) of fd
+  void open_stream(int fd, size_t pos, size_t len);
+
+  // Next chunk of the stream in order, returns bytes read, 0 at the end of
+  // the stream or (size_t)-1 with errno set on error. *data stays valid
+  // until the next call on this reader.
+  size_t read(int fd, const char **data);
+
+  // Wait for in-flight chunks of fd and forget the stream
+  void close_stream(int fd);
+
+  bool fixed_buffers() const { return fixed_; }
+
+ private:
+  struct Slot {
+    int stream;
+    bool done;
+    int res;
+  };
+
+  struct Stream {
+    int fd;
+    size_t next;
+    size_t end;
+    std::vector<size_t> slots;  // circular, in submission order
+    size_t head;
+    size_t count;
+  };
+
+  void submit_chunk(size_t stream_idx, size_t slot);
+  void reap(unsigned min_complete);
+  int find_stream(int fd) const;
+
+  size_t depth_;
+  size_t chunk_size_;
+  size_t io_align_;
+  HugePages huge_pages_;
+  size_t mem_align_;
+  bool fixed_;
+  Uring ring_;
+  std::vector<char *> bufs_;
+  std::vector<Slot> slots_;
+  std::vector<size_t> free_slots_;
+  std::vector<Stream> streams_;
+  long long last_slot_;
+  int last_stream_;
+};
+
+}  // namespace tps
+
+#endif  // URING_HPP
@@ -0,0 +1,168 @@
+#ifndef WARMUP_HPP
+#define WARMUP_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "helper.hpp"
+#include "live_stats.hpp"
+#include "timer.hpp"
+
+namespace tps {
+
+// "10s", "500ms" as a time or "1000ops" as a number of operations
+static bool parse_warmup(const std::string &str, long long *time,
+                         size_t *ops) {
+  try {
+    if (has_suffix(str, "ops", false)) {
+      *ops = to_size_t(str.substr(0, str.size() - 3));
+      *time = 0;
+    } else {
+      *time = std::max(0LL, time_in_ns(str));
+      *ops = 0;
+    }
+  } catch (const std::exception &) {
+    return false;
+  }
+  return true;
+}
+
+// Samples the throughput of all workers every period and flags steady
+// state once the coefficient of variation of the last samples stays below
+// the threshold.
+class SteadyState {
+ public:
+  static constexpr size_t NUM_SAMPLES = 5;
+
+  SteadyState(const LiveStats *live, double max_cv, long long period_ns)
+      : live_(live),
+        max_cv_(max_cv),
+        period_(period_ns),
+        steady_(false),
+        steady_time_(-1),
+        cv_(0.0),
+        stop_(false) {}
+
+  ~SteadyState() { stop(); }
+
+  SteadyState(const SteadyState &) = delete;
+  SteadyState &operator=(const SteadyState &) = delete;
+
+  void start() {
+    stop_ = false;
+    sampler_ = std::thread(&SteadyState::run, this);
+  }
+
+  void stop() {
+    if (!sampler_.joinable()) return;
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      stop_ = true;
+    }
+    cv_wait_.notify_all();
+    sampler_.join();
+  }
+
+  // Workers poll this once per operation
+  const std::atomic<bool> *flag() const { return &steady_; }
+
+  bool steady() const { return steady_.load(std::memory_order_relaxed); }
+  long long steady_time() const { return steady_time_; }
+  double cv() const { return cv_; }
+
+ private:
+  void run() {
+    std::vector<double> samples;
+    uint64_t prev_bytes = 0;
+    HighResTimer timer;
+    timer.start();
+    long long prev_ns = 0;
+    auto next = std::chrono::steady_clock::now();
+    while (true) {
+      next += std::chrono::nanoseconds(period_);
+      {
+        std::unique_lock<std::mutex> lock(mtx_);
+        if (cv_wait_.wait_until(lock, next, [this] { return stop_; })) break;
+      }
+      timer.stop();
+      long long now_ns = timer.elapsed_ns();
+      uint64_t ops, bytes;
+      live_->totals(&ops, &bytes);
+      samples.push_back(1.0 * (bytes - prev_bytes) / (now_ns - prev_ns));
+      if (samples.size() > NUM_SAMPLES) samples.erase(samples.begin());
+      prev_bytes = bytes;
+      prev_ns = now_ns;
+      if (samples.size() < NUM_SAMPLES) continue;
+
+      double mean = 0.0;
+      for (double s : samples) mean += s;
+      mean /= samples.size();
+      if (mean <= 0.0) continue;
+      double var = 0.0;
+      for (double s : samples) var += (s - mean) * (s - mean);
+      cv_ = sqrt(var / samples.size()) / mean;
+      if (cv_ < max_cv_) {
+        steady_time_ = now_ns;
+        steady_.store(true, std::memory_order_relaxed);
+        break;
+      }
+    }
+  }
+
+  const LiveStats *live_;
+  double max_cv_;
+  long long period_;
+  std::atomic<bool> steady_;
+  long long steady_time_;
+  double cv_;
+  std::thread sampler_;
+  std::mutex mtx_;
+  std::condition_variable cv_wait_;
+  bool stop_;
+};
+
+// Warm-up of one worker. It ends after the first operation that reaches
+// the time or the operation count, or that sees the steady state flag.
+class WarmupWindow {
+ public:
+  WarmupWindow(long long time, size_t ops, const std::atomic<bool> *steady)
+      : time_(time > 0 ? time : std::numeric_limits<long long>::max()),
+        ops_(ops > 0 ? ops : std::numeric_limits<size_t>::max()),
+        steady_(steady),
+        active_(time > 0 || ops > 0 || steady != nullptr),
+        by_steady_(false) {}
+
+  bool active() const { return active_; }
+
+  // True if the steady state flag ended warm-up
+  bool by_steady() const { return by_steady_; }
+
+  // Called after every operation while active, true when warm-up ends
+  bool end(size_t ops, long long now_ns) {
+    if (steady_ != nullptr && steady_->load(std::memory_order_relaxed))
+      by_steady_ = true;
+    else if (now_ns < time_ && ops < ops_)
+      return false;
+    active_ = false;
+    return true;
+  }
+
+ private:
+  long long time_;
+  size_t ops_;
+  const std::atomic<bool> *steady_;
+  bool active_;
+  bool by_steady_;
+};
+
+}  // namespace tps
+
+#endif  // WARMUP_HPP